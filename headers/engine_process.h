@@ -0,0 +1,73 @@
+#ifndef ENGINE_PROCESS_H
+#define ENGINE_PROCESS_H
+
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "./game_manager.h"
+
+
+#define ENGINE_ERROR -62
+
+
+/**
+ * The parameters of an MCTS AI.
+*/
+typedef struct engine_config {
+    uint32_t max_visits;
+    double exploration;
+} engine_config_t;
+
+
+/**
+ * An MCTS AI running in its own child process. The MCTS module keeps its state in global variables,
+ * so running each AI in a separate process allows several of them to play simultaneously.
+*/
+typedef struct engine_process {
+    pid_t pid;          // -1 if no process is running
+    int to_engine;      // pipe on which the opponent's moves are sent
+    int from_engine;    // pipe on which the AI's moves are received
+} engine_process_t;
+
+#define ENGINE_STOPPED {-1, -1, -1}    // an engine running no process, which 'engine_stop' ignores
+
+
+/**
+ * Starts an MCTS AI in a child process, and lets it play its first move if it is its turn after the opening.
+ *
+ * @param engine the engine to start. Is assumed non-null.
+ * @param config the parameters of the AI
+ * @param playing_as the role played by the AI. Must be PLAYER_A or PLAYER_B
+ * @param opening the moves played before the AI starts playing (see 'init_MCTS_from_opening')
+ * @param opening_length the number of moves in the opening
+ * @param seed the seed of the random generator of the AI
+ * @param think_ns if non-null, set to the time (in nanoseconds) the AI took to decide its first move
+ *
+ * @returns the value returned by 'init_MCTS_from_opening' in the child process;
+ * ENGINE_ERROR if the process could not be started or didn't answer. The engine is then stopped, and any child process
+ * it started was waited for.
+*/
+col_t engine_start(engine_process_t* engine, engine_config_t config, player_t playing_as,
+        const col_t* opening, uint8_t opening_length, uint32_t seed, uint64_t* think_ns);
+
+
+/**
+ * Sends the opponent's move to an AI and waits for its answer.
+ *
+ * @param engine the engine, started with 'engine_start'
+ * @param col the column the opponent played in
+ * @param think_ns if non-null, set to the time (in nanoseconds) the AI took to decide its move
+ *
+ * @returns the value returned by 'input_MCTS' in the child process;
+ * ENGINE_ERROR if the communication with the process failed.
+*/
+col_t engine_input(engine_process_t* engine, col_t col, uint64_t* think_ns);
+
+
+/**
+ * Stops an AI and waits for the end of its process. Does nothing if the engine is already stopped (see ENGINE_STOPPED).
+*/
+void engine_stop(engine_process_t* engine);
+
+
+#endif /* ENGINE_PROCESS_H */
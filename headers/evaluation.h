@@ -0,0 +1,36 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+
+#include "./game_manager.h"
+
+
+/**
+ * Estimates how good a position is for a player with a static evaluation of the bitboards, without any search.
+ * The evaluation weighs :
+ * - the open rows of CONNECT_N-1 disks, as the empty cells which would complete a winning row for each player (threats) ;
+ * - the parity of those threats : the first player benefits from threats on the odd rows (counted from 1 at the bottom),
+ * the second player from threats on the even rows, since the end of a game usually lets each player fill those rows ;
+ * - the control of the centre, as the disks weighted by the number of rows of CONNECT_N cells crossing their column ;
+ * - the immediate threats of the player whose turn it is.
+ *
+ * @param game the position. Is assumed non-null.
+ * @param player the player for which the position is evaluated. Must be PLAYER_A or PLAYER_B
+ *
+ * @returns a value in [0, 1] estimating the probability that 'player' wins : 1 if they have already won, 0 if they have lost,
+ * 0.5 for a draw or a balanced position.
+*/
+float evaluate(game_t* game, player_t player);
+
+
+/**
+ * A policy for the PUCT selection of the MCTS algorithm, from the static evaluation : the prior of each valid move is
+ * the softmax of the evaluations of the positions it leads to, for the player making it.
+ *
+ * @param game the position, not finished. Is assumed non-null.
+ * @param priors filled with the probability of each move ; 0 for the invalid moves.
+*/
+void heuristic_policy(game_t* game, float priors[ROW_LENGTH]);
+
+
+#endif /* EVALUATION_H */
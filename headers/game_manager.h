@@ -10,27 +10,165 @@
 #define DRAW 2
 #define ARG_ERROR -64
 #define MEM_ERROR -63
+
+/*
+The dimensions of the board and the win length are set at build time, e.g. with -DROW_LENGTH=8 -DCOL_HEIGHT=7 (see BOARD
+in the Makefile). They are constants everywhere, so every bitboard shift and mask is folded by the compiler for the size
+built, and the win detectors are unrolled into the shift chains of the win length.
+*/
+#ifndef ROW_LENGTH
 #define ROW_LENGTH 7
+#endif
+#ifndef COL_HEIGHT
 #define COL_HEIGHT 6
+#endif
+#ifndef CONNECT_N
+#define CONNECT_N 4    // the number of aligned disks which wins the game, e.g. 5 with -DCONNECT_N=5 for Connect-5
+#endif
+#define NB_CELLS (ROW_LENGTH*COL_HEIGHT)
+#define PADDED_ROW (ROW_LENGTH+1)    // width of the rows of the padded bitboards
+
+/*
+The grids and the bitboards are 64-bit words when the board fits in them (up to 8x7), and 128-bit words otherwise
+(up to 10x10 and beyond), with the same layouts and the same shift-based win detection. The 128-bit backend can also be
+forced with -DWIDE_BITBOARDS, e.g. to measure its cost on the 7x6 board.
+*/
+#if !defined(WIDE_BITBOARDS) && (NB_CELLS > 61 || COL_HEIGHT*PADDED_ROW > 63 || ROW_LENGTH*(COL_HEIGHT+1) > 64)
+#define WIDE_BITBOARDS
+#endif
+
+#ifdef WIDE_BITBOARDS
+typedef __int128 grid_t;
+typedef unsigned __int128 bitboard_t;
+#else
+typedef int64_t grid_t;
+typedef uint64_t bitboard_t;
+#endif
+#define GRID_BITS (8*(int) sizeof(grid_t))
+
+#define PADDED_BOARD ((((bitboard_t) 1 << (COL_HEIGHT*PADDED_ROW)) - 1) / (((bitboard_t) 1 << PADDED_ROW) - 1) \
+        * (((bitboard_t) 1 << ROW_LENGTH) - 1))    // the cells of the board in a padded bitboard
+#define TURN_BIT ((grid_t) 1 << (GRID_BITS-2))
+#define WIN_BIT ((grid_t) 1 << (GRID_BITS-3))
+
+_Static_assert(CONNECT_N >= 2, "a win needs at least 2 aligned disks");
+_Static_assert(ROW_LENGTH >= CONNECT_N && COL_HEIGHT >= CONNECT_N, "the board must fit a winning row in each direction");
+_Static_assert(ROW_LENGTH <= 16, "the columns are stored in 16-bit masks");
+_Static_assert(NB_CELLS <= GRID_BITS-3, "the cells of the grids must be below WIN_BIT");
+_Static_assert(COL_HEIGHT*PADDED_ROW < GRID_BITS, "the padded bitboards must fit in a bitboard");
 
 
 typedef int8_t player_t;
 typedef int8_t col_t;
-typedef int64_t grid_t;
 typedef int64_t boolean;
 
+
+/**
+ * Returns the number of bits set in a bitboard.
+*/
+static inline uint8_t bitboard_popcount(bitboard_t bits) {
+#ifdef WIDE_BITBOARDS
+    return __builtin_popcountll((uint64_t) bits) + __builtin_popcountll((uint64_t) (bits >> 64));
+#else
+    return __builtin_popcountll(bits);
+#endif
+}
+
+
+/**
+ * Returns the index of the lowest bit set in a bitboard, which must not be 0.
+*/
+static inline uint8_t bitboard_lowest_bit(bitboard_t bits) {
+#ifdef WIDE_BITBOARDS
+    return ((uint64_t) bits != 0) ? __builtin_ctzll((uint64_t) bits) : 64 + __builtin_ctzll((uint64_t) (bits >> 64));
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+
+/**
+ * Returns the cells which start a row of CONNECT_N disks of a bitboard, the row going from the cell towards the higher
+ * bits by steps of 'shift' bits. The rows are found by a chain of shifts doubling the length of the rows found at each step,
+ * which the compiler unrolls for the win length (2 shifts for Connect4, 3 for Connect5).
+ * 
+ * @param disks the disks of a player, in a layout where the rows can't wrap around the edges of the board by 'shift'
+ * @param shift the distance in bits between two consecutive cells of a row
+*/
+static inline bitboard_t rows_of_n(bitboard_t disks, uint8_t shift) {
+    bitboard_t rows = disks;
+    uint8_t length = 1;    // the length of the rows starting at the cells of 'rows'
+    while (2*length <= CONNECT_N) {
+        rows &= rows >> (length*shift);
+        length *= 2;
+    }
+    if (length < CONNECT_N) rows &= rows >> ((CONNECT_N-length)*shift);    // two overlapping rows of 'length' disks
+    return rows;
+}
+
+
+/**
+ * Returns the cells which would complete a row of CONNECT_N disks with CONNECT_N-1 disks of a padded bitboard (see
+ * 'pad_grid'), the row going by steps of 'shift' bits, whether the cells are empty or not. The result may have bits
+ * outside of the board.
+ *
+ * @param disks the padded bitboard of the disks of a player
+ * @param shift the distance in bits between two consecutive cells of a row : 1, PADDED_ROW, PADDED_ROW+1 or PADDED_ROW-1
+*/
+static inline bitboard_t completing_cells_along(bitboard_t disks, uint8_t shift) {
+    // before[k] : the cells with k disks just before them (towards the lower bits) ; after[k] : the same after them
+    // The loops are unrolled so that the arrays live in registers : play is 3 times slower otherwise
+    bitboard_t before[CONNECT_N], after[CONNECT_N];
+    before[0] = after[0] = ~(bitboard_t) 0;
+#pragma GCC unroll 16
+    for (uint8_t k = 1; k < CONNECT_N; k++) {
+        before[k] = before[k-1] & (disks << k*shift);
+        after[k] = after[k-1] & (disks >> k*shift);
+    }
+    // A cell completes a row with k disks before it and CONNECT_N-1-k disks after it
+    bitboard_t cells = 0;
+#pragma GCC unroll 16
+    for (uint8_t k = 0; k < CONNECT_N; k++) cells |= before[k] & after[CONNECT_N-1-k];
+    return cells;
+}
+
+
+/**
+ * Returns the cells of a padded bitboard within CONNECT_N-1 steps of 'shift' bits of a cell, the cell included : the
+ * cells which share a row of CONNECT_N cells with it in this direction. Past an edge of the board, the line goes on
+ * through a padding bit, which no row of CONNECT_N cells crosses, so the extra cells don't matter.
+ *
+ * @param bit the index of the cell in the padded bitboard
+ * @param shift the distance in bits between two consecutive cells of the line
+*/
+static inline bitboard_t line_through(uint8_t bit, uint8_t shift) {
+    // The halves of the line are constant rows of CONNECT_N cells, from the lowest bit and from the highest one
+    const uint8_t highest_bit = 8*sizeof(bitboard_t) - 1;
+    bitboard_t from_lowest = 0, from_highest = 0;
+#pragma GCC unroll 16
+    for (uint8_t k = 0; k < CONNECT_N; k++) {
+        from_lowest |= (bitboard_t) 1 << k*shift;
+        from_highest |= (bitboard_t) 1 << (highest_bit - k*shift);
+    }
+    return (from_lowest << bit) | (from_highest >> (highest_bit - bit));
+}
+
+
 /**
- * Bit 62 : 1 if it's the player's turn
- * Bit 61 : 1 if the player has won the game
+ * Bit GRID_BITS-2 : 1 if it's the player's turn
+ * Bit GRID_BITS-3 : 1 if the player has won the game
  * 
- * Bits 41 -> 35 : last row (highest)
+ * Bits NB_CELLS-1 -> NB_CELLS-ROW_LENGTH : last row (highest)
  * ...
- * Bits 6 -> 0 : first row (lowest)
+ * Bits ROW_LENGTH-1 -> 0 : first row (lowest)
 */
 typedef struct game {
     grid_t gridA;
     grid_t gridB;
+    bitboard_t threats[2];  // for PLAYER_A and PLAYER_B, the padded bitboard (see 'pad_grid') of the empty cells which would
+                            // complete a Connect4 for the player. Updated by 'play' on the lines through the new disk
     col_t cols_occupation[ROW_LENGTH];
+    uint8_t ply;            // the number of disks on the board : the game is a draw when it reaches NB_CELLS without a win
 } game_t;
 
 
@@ -89,7 +227,7 @@ player_t winner(game_t* game);
  * 
  * @param game the current state of the game to which apply the move and (if successful) the results
  * @param player the player who attempts to play the move. Must be PLAYER_A or PLAYER_B
- * @param col the column in which the player attempts to add a disk. Must be contained in [0, 6].
+ * @param col the column in which the player attempts to add a disk. Must be contained in [0, ROW_LENGTH[.
  * 
  * @returns 2 if the move is valid an results in a draw, and 'game' is updated to implement this move;
  * 1 if the move is valid and results in a win for 'player', and 'game' is updated to implement this move;
@@ -106,7 +244,7 @@ int8_t play(game_t* game, player_t player, col_t col);
  * Just like 'play', but the move is automatically played by the player whose turn it is. 
  * 
  * @param game the current state of the game to which apply the move and (if successful) the results
- * @param col the column in which the player attempts to add a disk. Must be contained in [0, 6].
+ * @param col the column in which the player attempts to add a disk. Must be contained in [0, ROW_LENGTH[.
  * 
  * @returns 2 if the move is valid an results in a draw, and 'game' is updated to implement this move;
  * 1 if the move is valid and results in a win for 'player', and 'game' is updated to implement this move;
@@ -119,19 +257,34 @@ int8_t play(game_t* game, player_t player, col_t col);
 int8_t play_auto(game_t* game, col_t col);
 
 
+/**
+ * Takes back the latest move of a game, in place : the disk on top of the column is removed, and the turn, the win flag,
+ * the column heights and the threat maps are restored to their state before the move. Moves can thus be tried and
+ * taken back on a single game instead of on copies.
+ * 
+ * @param game the game whose latest move is taken back
+ * @param col the column of the latest move. Must be contained in [0, ROW_LENGTH[.
+ * 
+ * @returns 0 if the move is taken back, and 'game' is updated;
+ * -1 if the disk on top of the column is not a disk of the latest player, so the latest move was not played there;
+ * -2 if the column is empty;
+ * ARG_ERROR if the arguments are invalid
+*/
+int8_t unplay(game_t* game, col_t col);
+
+
 /**
  * Returns the result of playing a move for a game of Connect4 WITHOUT updating the given game.
  * The play is automatically played for the player's whose turn it is.
  * 'game' is unchanged after calling this function.
  * 
  * @param game the current state of the game to which apply the move and (if successful) the results
- * @param col the column in which the player attempts to add a disk. Must be contained in [0, 6].
+ * @param col the column in which the player attempts to add a disk. Must be contained in [0, ROW_LENGTH[.
  * 
  * @returns 1 if the move is valid and results in a win;
  * 0 if the move is valid;
  * -2 if the targetted column is full;
  * -3 if the game is already finished;
- * MEM_ERROR if the memory allocation for an intern variable fails
  * ARG_ERROR if the arguments are invalid
 */
 int8_t play_auto_without_update(game_t* game, col_t col);
@@ -151,6 +304,92 @@ int8_t play_auto_without_update(game_t* game, col_t col);
 game_t* play_copy_auto(game_t* game, col_t col);
 
 
+/**
+ * Converts a grid to a padded bitboard : the cell (col, row) is the bit row*PADDED_ROW + (ROW_LENGTH-1-col), like in the grid
+ * but with one always empty bit at the end of each row. Shifting a padded bitboard by 1, PADDED_ROW, PADDED_ROW+1 or
+ * PADDED_ROW-1 then moves its disks along a row, a column or a diagonal, and the padding bits stop the rows of cells
+ * from wrapping around the edges of the board.
+ * 
+ * @param grid the grid of a player
+ * 
+ * @returns the padded bitboard of the disks of the grid
+*/
+static inline bitboard_t pad_grid(grid_t grid) {
+    bitboard_t padded = 0;
+#pragma GCC unroll 16
+    for (int8_t row = 0; row < COL_HEIGHT; row++)
+        padded |= (((bitboard_t) grid >> (row*ROW_LENGTH)) & (((bitboard_t) 1 << ROW_LENGTH) - 1)) << (row*PADDED_ROW);
+    return padded;
+}
+
+
+/**
+ * Returns the cells which would complete a row of CONNECT_N disks with CONNECT_N-1 disks of a padded bitboard, whether they
+ * are empty or not.
+ * 
+ * @param disks the padded bitboard of the disks of a player
+ * 
+ * @returns the padded bitboard of the completing cells. It may have bits outside of the board.
+*/
+bitboard_t completing_cells(bitboard_t disks);
+
+
+/**
+ * Returns the columns in which a player would make a Connect4 by playing now, whether it is their turn or not.
+ * The game is neither copied nor modified.
+ * 
+ * @param game the game. Is assumed non-null and not finished.
+ * @param player the player. Must be PLAYER_A or PLAYER_B
+ * 
+ * @returns the mask of these columns : bit 'col' is set if playing in the column 'col' makes a Connect4 for 'player';
+ * 0 if there is none.
+*/
+uint16_t winning_columns(game_t* game, player_t player);
+
+
+/**
+ * Makes a move for the player whose turn it is, without any of the checks of 'play', for the engine loops (such as the
+ * playouts) which only generate valid moves. 'play' calls it once the move is checked.
+ * 
+ * @param game the game to which apply the move. Is assumed non-null and not finished.
+ * @param col the column in which the disk is added. Must be contained in [0, ROW_LENGTH[, and the column must not be full.
+ * 
+ * @returns 2 if the move results in a draw;
+ * 1 if the move results in a win for the player who played it;
+ * 0 otherwise.
+*/
+static inline int8_t play_unchecked(game_t* game, col_t col) {
+    player_t player = (game->gridA & TURN_BIT) ? PLAYER_A : PLAYER_B;
+    grid_t* this_grid = (player == PLAYER_A) ? &game->gridA : &game->gridB;
+    grid_t* other_grid = (player == PLAYER_A) ? &game->gridB : &game->gridA;
+    int8_t row = game->cols_occupation[col]++;
+    game->ply++;
+    uint8_t padded_index = row*PADDED_ROW + ROW_LENGTH-1-col;
+    bitboard_t padded_bit = (bitboard_t) 1 << padded_index;
+    boolean makes_connect4 = (game->threats[player] & padded_bit) != 0;    // the cell completes a Connect4
+    *this_grid = (*this_grid | ((grid_t) 1 << (row*ROW_LENGTH + ROW_LENGTH-1-col))) & ~TURN_BIT;
+    *other_grid |= TURN_BIT;
+
+    // Only the player who added the disk can get new threats, on the rows of CONNECT_N cells through the disk : the other
+    // rows have the same disks as before. The cell of the disk is no threat anymore for either player
+    bitboard_t disks = pad_grid(*this_grid);
+    const uint8_t shifts[4] = {1, PADDED_ROW, PADDED_ROW+1, PADDED_ROW-1};
+    bitboard_t new_threats = 0;
+#pragma GCC unroll 4
+    for (uint8_t i = 0; i < 4; i++)
+        new_threats |= completing_cells_along(disks, shifts[i]) & line_through(padded_index, shifts[i]);
+    new_threats &= PADDED_BOARD & ~(disks | pad_grid(*other_grid));
+    game->threats[player] = (game->threats[player] & ~padded_bit) | new_threats;
+    game->threats[1-player] &= ~padded_bit;
+
+    if (makes_connect4) {
+        *this_grid |= WIN_BIT;
+        return 1;
+    }
+    return (game->ply == NB_CELLS) ? 2 : 0;
+}
+
+
 void print_game(game_t* game);
 
 #endif /* GAME_MANAGER_H */
\ No newline at end of file
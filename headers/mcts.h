@@ -3,20 +3,94 @@
 
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <math.h>
 #include "./game_manager.h"
 
 
 #define MEMERROR INT8_MIN
 #define MCTS_FAIL -2
+#define TREE_FILE_MAX_DEPTH 16    // number of plies below the root kept in the tree file of init_MCTS_from_file
+#define MAX_SIMULATION_THREADS 64
+#define MAX_SEARCH_THREADS 64
+#define MAX_LEAVES_PER_BATCH 64
 
 
+#define CHILDREN_LANES ((ROW_LENGTH <= 8) ? 8 : 16)    // ROW_LENGTH rounded up to the width of a vector register
+
+_Static_assert(ROW_LENGTH <= CHILDREN_LANES, "the children statistics must fit in CHILDREN_LANES lanes");
+
+
+/**
+ * The statistics of a node packed in one 64-bit word : its number of wins in the high 32 bits, and its number of visits
+ * in the low 32 bits. Both are updated at once by a single atomic addition and read at once by a single atomic load,
+ * so that concurrent searches need no lock and never see wins without their visits.
+*/
+typedef uint64_t packed_stats_t;
+
+
+/**
+ * The statistics of the children of a node, in one lane per column. They are stored contiguously in the parent
+ * (structure of arrays) so that the UCB weights of all the children are computed in one pass over the lanes.
+ * The lanes without a child, and the lanes in [ROW_LENGTH, CHILDREN_LANES[, have no wins nor visits.
+*/
+typedef struct children_stats {
+    packed_stats_t lanes[CHILDREN_LANES];
+    float bias[CHILDREN_LANES];    // the static evaluation of each child for the player choosing it, if the progressive bias is enabled
+    float priors[CHILDREN_LANES];    // the probability of each move given by the policy of PUCT, if any
+} children_stats_t;
+
+
+/**
+ * A policy giving the prior probability of each move of a position, for the PUCT selection.
+ * 
+ * @param game the position, not finished. Is assumed non-null and must not be modified.
+ * @param priors filled with the probability of each move. The invalid moves must get 0, and the others should sum up to 1.
+*/
+typedef void (*policy_function_t)(game_t* game, float priors[ROW_LENGTH]);
+
+
+/**
+ * An evaluator replacing the random playouts of the simulations (e.g. 'network_evaluate').
+ * 
+ * @param games the positions to evaluate, not finished. Are assumed non-null and must not be modified.
+ * @param nb_games the number of positions
+ * @param values filled with the probability that the player to move in games[i] wins
+ * @param priors filled with the probability of each move of games[i], as by a policy. May be NULL if not needed.
+ * 
+ * @returns 0 in case of success; a negative value otherwise.
+*/
+typedef int8_t (*evaluator_function_t)(game_t* const* games, uint32_t nb_games, float* values, float (*priors)[ROW_LENGTH]);
+
+
+#define NOT_EXPANDED 0
+#define EXPANDING 1    // claimed by a search thread, whose children are being created
+#define EXPANDED 2
+
+
+/**
+ * The index of a node in the node arena of the MCTS. Index NO_NODE is never given to a node : it stands for a missing
+ * parent or child, as NULL would for a pointer.
+*/
+typedef uint32_t node_index_t;
+
+#define NO_NODE 0
+
+
+/**
+ * A node of the MCTS tree. The statistics of a node are stored in the children_stats of its parent, at lane 'index'
+ * (or in a separate block for the root of the tree).
+ * The nodes live in the node arena of the MCTS and are linked by their 32-bit indices in it rather than by pointers.
+*/
 typedef struct mcts_node {
+    children_stats_t children_stats;
     game_t* state;
-    uint32_t nb_wins;
-    uint32_t nb_visits;
-    struct mcts_node* parent;
-    struct mcts_node* children[ROW_LENGTH];
+    node_index_t parent;
+    node_index_t children[ROW_LENGTH];
+    node_index_t id;    // the index of this node in the node arena
+    col_t index;    // the column of the move leading from the parent to this node
+    uint8_t expansion;    // NOT_EXPANDED, EXPANDING while a parallel search creates its children, or EXPANDED once it has children
+    uint8_t has_priors;    // whether children_stats.priors was filled by the policy. Uniform priors are assumed otherwise
 } node_t;
 
 
@@ -34,15 +108,193 @@ typedef struct mcts_node {
 col_t init_MCTS(player_t playing_as, uint32_t max_iter);
 
 
+/**
+ * Just like 'init_MCTS', but warm-starts the MCTS algorithm from the tree saved in a tree file by a previous session,
+ * so that its simulations don't need to be computed again.
+ * If the file doesn't exist yet, the tree starts empty and is written to the file. If the file can not be used (e.g. it
+ * is corrupted or was saved for another board or for the other role), a warning is printed on the standard error, the
+ * tree starts empty and the file is left unchanged.
+ * Until the game is TREE_FILE_MAX_DEPTH plies deep, each search adds max_iter visits to those of the tree, whatever the
+ * visits loaded, and the branches not played are kept down to TREE_FILE_MAX_DEPTH. The tree is then written back to the
+ * file, for either role, once the game gets deeper or when 'destroy_MCTS' is called.
+ * 
+ * @param playing_as the role played by the AI in a Connect4 game. Must be PLAYER_A or PLAYER_B
+ * @param max_iter the maximum number of iterations by the MCTS algorithm before returning a result.
+ * @param path the path to the tree file. If NULL, behaves exactly like 'init_MCTS'.
+ * 
+ * @returns the same values as 'init_MCTS'
+*/
+col_t init_MCTS_from_file(player_t playing_as, uint32_t max_iter, const char* path);
+
+
+/**
+ * Just like 'init_MCTS', but the game starts after an opening sequence of moves, played alternately by both players
+ * starting with PLAYER_A. If it is then the AI's turn to play, it runs the MCTS algorithm and returns its move.
+ * 
+ * @param playing_as the role played by the AI in a Connect4 game. Must be PLAYER_A or PLAYER_B
+ * @param max_iter the maximum number of iterations by the MCTS algorithm before returning a result.
+ * @param opening the columns of the opening moves, in [0, ROW_LENGTH[. May be NULL if opening_length == 0.
+ * @param opening_length the number of moves in the opening
+ * 
+ * @returns ROW_LENGTH if it is not the AI's turn to play after the opening;
+ * A number in [0,ROW_LENGTH[ that represents the column which the AI decides to play in otherwise;
+ * ARG_ERROR if the arguments passed are invalid, including an invalid move or a move ending the game in the opening.
+ * MEMERROR if a memory error occurs
+*/
+col_t init_MCTS_from_opening(player_t playing_as, uint32_t max_iter, const col_t* opening, uint8_t opening_length);
+
+
+/**
+ * Sets the exploration constant used in the UCB formula during the selection step of the MCTS algorithm. Defaults to 0.9.
+ * The higher, the more the MCTS algorithm explores the moves estimated as weaker.
+ * 
+ * @param exploration the exploration constant. Should be positive.
+*/
+void set_MCTS_exploration(double exploration);
+
+
+/**
+ * Enables the batch playouts : at each expansion, all the new children are created first, and a batch of playouts
+ * is then run for them at once by the vectorised playout kernel, instead of one playout per child.
+ * 
+ * @param playouts_per_child the number of playouts run for each new child. 0 (the default) disables the batch playouts.
+*/
+void set_MCTS_batch_playouts(uint8_t playouts_per_child);
+
+
+/**
+ * Selects the children with the PUCT formula instead of UCB1 : the weight of a child is Q + c * P * sqrt(N) / (1 + n), where
+ * Q is its win ratio for the player choosing it, P its prior probability given by the policy, N the visits of its parent and n
+ * its own visits. The policy is run once for each node getting children. Should be called before the MCTS is initialised.
+ * 
+ * @param policy the policy giving the priors (e.g. 'heuristic_policy'). NULL (the default) selects with UCB1.
+ * @param c_puct the weight c of the priors in the formula
+*/
+void set_MCTS_policy(policy_function_t policy, double c_puct);
+
+
+/**
+ * Replaces the playouts by an evaluator : each new child gets the value of its position, counted as visits_per_evaluation
+ * visits with the matching share of wins, and the priors of its own children, which the PUCT selection then uses instead of
+ * calling the policy (see set_MCTS_policy). With a single search thread, the search selects up to leaves_per_batch leaves
+ * before expanding them, adding a virtual loss to their paths as the parallel search does, so that all their children are
+ * evaluated in one call. The positions for which the evaluator fails get a value of 0.5.
+ * 
+ * @param evaluator the evaluator. NULL (the default) runs the playouts.
+ * @param visits_per_evaluation the number of visits an evaluation is worth, at least 1. Defaults to 16.
+ * @param leaves_per_batch the number of leaves expanded together, in [1, MAX_LEAVES_PER_BATCH]. Defaults to 8.
+*/
+void set_MCTS_evaluator(evaluator_function_t evaluator, uint8_t visits_per_evaluation, uint8_t leaves_per_batch);
+
+
+/**
+ * Enables the progressive bias : the UCB weight of each child gets an extra term weight * h / (n + 1), where h in [0, 1] is
+ * the static evaluation of the child for the player choosing it (see 'evaluate') and n its number of visits. The search then
+ * favours the moves which look strong (central, creating threats) while they have few visits, and the term fades as their
+ * simulations accumulate.
+ * 
+ * @param weight the weight of the bias term, relative to the win ratio in [0, 1]. 0 (the default) disables it.
+*/
+void set_MCTS_progressive_bias(double weight);
+
+
+/**
+ * Runs the simulations of each expansion on several threads : all the new children are created first, then their playouts
+ * are split between the searching thread and nb_threads-1 tasks of the thread pool, all finished before the backpropagation.
+ * The tree itself is only ever accessed by the searching thread. Implies batch playouts, with at least one playout per child.
+ * The thread pool is started at the next search, and stopped by destroy_MCTS.
+ * 
+ * @param nb_threads the number of threads running the simulations, in [1, MAX_SIMULATION_THREADS]. 1 (the default) runs them
+ * on the searching thread only.
+*/
+void set_MCTS_simulation_threads(uint8_t nb_threads);
+
+
+/**
+ * Runs each search on several threads sharing the tree (tree parallelisation). Each thread runs whole iterations : it selects
+ * a leaf, adding a virtual loss to the nodes of its path so that the other threads explore other paths meanwhile, expands it
+ * if no other thread is doing so, and backpropagates the results with atomic additions. Implies batch playouts, with at least
+ * one playout per child, and runs the simulations on the searching threads only (see set_MCTS_simulation_threads).
+ * The statistics of the search then only time the whole search and the simulations, not the other steps.
+ * 
+ * @param nb_threads the number of threads searching the tree, in [1, MAX_SEARCH_THREADS]. 1 (the default) runs the search
+ * on the calling thread only.
+*/
+void set_MCTS_search_threads(uint8_t nb_threads);
+
+
+/**
+ * Lets the searches stop before using their whole visit budget. With 'enabled', a search stops as soon as its most visited
+ * move leads the second one by more visits than the remaining budget : the choice can't change anymore, only the think time
+ * is saved. With a positive 'confidence', a search also stops once the win ratio of its most visited move exceeds the win
+ * ratio of every other move by 'confidence' standard deviations (with the variance of a ratio over n visits bounded by
+ * 1/(4n)) : this saves more time, but the choice may rarely differ from the one of a full search.
+ * In both cases, the next searches reuse a smaller tree. Both rules are disabled by default.
+ * 
+ * @param enabled whether the search stops once its choice can't change anymore
+ * @param confidence the number of standard deviations of the confidence-based rule. 0 disables it.
+*/
+void set_MCTS_early_stop(boolean enabled, double confidence);
+
+
+/**
+ * Sets whether the threads of the thread pool used by the parallel searches are pinned to their own CPU. Defaults to 1.
+ * Pinning should be disabled when several AIs use threads at the same time, since their workers would share the same CPUs.
+ * 
+ * @param pin 1 to pin the threads, 0 to let the system move them
+*/
+void set_MCTS_pin_threads(boolean pin);
+
+
+/**
+ * Requests the statistics of each run of the MCTS algorithm. After each search, one line of JSON is written on 'output'
+ * with : the ply of the searched position, the chosen column, the number of iterations, whether the search stopped early,
+ * the number of playouts and of evaluations, the playouts per second, the number of nodes allocated, the visits of the root,
+ * the visits recombined when progressing in the tree, the maximum depth and the histogram of the depths of the selected
+ * leaves, the time spent in each step of the algorithm (in ms), and the activity of the workers of the thread pool (tasks
+ * run, tasks stolen, failed steal attempts and idle time). These fields are filled by every kind of search : with several
+ * search threads, the times of the steps are summed over the threads, and may exceed the total time.
+ * Collecting the statistics slightly slows down the search.
+ * 
+ * @param output the stream on which to write the statistics. NULL (the default) disables the statistics.
+*/
+void set_MCTS_stats_output(FILE* output);
+
+
+/**
+ * Gives the visits of each move at the root of the latest search, from which the AI chose the most visited move.
+ * 
+ * @param visits filled with the visits of the child of the root for each column; 0 for the invalid moves, or for all
+ * of them if no search was run yet.
+*/
+void get_MCTS_root_visits(uint32_t visits[ROW_LENGTH]);
+
+
+/**
+ * Saves the current MCTS tree (the statistics of its nodes, and the state at its root) to a tree file.
+ * 
+ * @param path the path to the tree file. It is overwritten if it already exists.
+ * @param max_depth the number of levels of nodes below the root to save. Deeper nodes are discarded.
+ * 
+ * @returns 0 if the tree was saved;
+ * -1 if the file could not be written;
+ * ARG_ERROR if the arguments are invalid or if the MCTS was not initialised
+*/
+int8_t save_MCTS(const char* path, uint8_t max_depth);
+
+
+/**
+ * Frees the MCTS tree, after writing it to the tree file of 'init_MCTS_from_file' if it wasn't written yet.
+*/
 void destroy_MCTS();
 
 
 /**
  * Accepts an input move from the player, and returns the move played by the AI in return and decided using the MCTS algorithm.
  * 
- * @param col the column the player decides to play in. Must be in [0, 6]
+ * @param col the column the player decides to play in. Must be in [0, ROW_LENGTH[
  * 
- * @returns the column in [0, 6] the AI chose to make its move if everything goes well;
+ * @returns the column in [0, ROW_LENGTH[ the AI chose to make its move if everything goes well;
  * ARG_ERROR if the argments are invalid;
  * -1 if the move played by the live player is invalid (column full, ...)
  * MCTS_FAIL in case of MTCS failure (no move could be computed due to an exception or an critical lack of memory)
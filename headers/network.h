@@ -0,0 +1,81 @@
+#ifndef NETWORK_H
+#define NETWORK_H
+
+
+#include <stdint.h>
+#include "./game_manager.h"
+
+
+#define NETWORK_INPUTS (2*NB_CELLS)    // one input per cell and per player
+#define NETWORK_OUTPUTS (1+ROW_LENGTH)              // the value, then the logit of each move
+#define NETWORK_MAX_HIDDEN 512
+#define NETWORK_ERROR -60
+
+
+/*
+The network is a quantised MLP with one hidden layer, evaluated on the CPU (with AVX2 if available) :
+- the inputs are the 2*NB_CELLS bits of the board (84 on the 7x6 board), seen by the player to move : the cell (col, row) is the input
+  row*ROW_LENGTH + (ROW_LENGTH-1-col) for the disks of that player, and the same plus NB_CELLS for the disks of the opponent ;
+- the hidden layer sums the int16 weights of the inputs set (the inputs are 0 or 1) to its int16 biases, shifts the sums
+  right by 'hidden_shift' bits and clamps them to [0, 127] ;
+- the output layer computes the int32 dot products of the hidden values with its int8 weights, plus its int32 biases,
+  and multiplies them by 'output_scale'. The first output is the logit of the probability that the player to move wins,
+  the others the logits of the moves, whose softmax over the valid moves gives the priors.
+
+The weights file is written in the native byte order :
+    magic "C4NN" | version (uint8, 1) | hidden_shift (uint8) | nb_hidden (uint16, multiple of 16, <= NETWORK_MAX_HIDDEN)
+    | output_scale (float32) | hidden weights (int16, NETWORK_INPUTS rows of nb_hidden) | hidden biases (int16, nb_hidden)
+    | output weights (int8, NETWORK_OUTPUTS rows of nb_hidden) | output biases (int32, NETWORK_OUTPUTS)
+*/
+
+
+/**
+ * Loads the weights of the network from a file, replacing the network loaded before if any.
+ *
+ * @param path the path of the weights file
+ *
+ * @returns 0 in case of success;
+ * ARG_ERROR if the file can't be opened;
+ * NETWORK_ERROR if the file is not a valid weights file (the previous network is then kept);
+ * MEM_ERROR in case of memory allocation error.
+*/
+int8_t load_network(const char* path);
+
+
+/**
+ * Returns whether a network is loaded.
+*/
+boolean has_network();
+
+
+/**
+ * Evaluates a batch of positions with the loaded network.
+ *
+ * @param games the positions, not finished. Are assumed non-null.
+ * @param nb_games the number of positions
+ * @param values filled with the probability that the player to move in games[i] wins
+ * @param priors filled with the probability of each move of games[i], 0 for the invalid moves. May be NULL if not needed.
+ *
+ * @returns 0 in case of success;
+ * NETWORK_ERROR if no network is loaded.
+*/
+int8_t network_evaluate(game_t* const* games, uint32_t nb_games, float* values, float (*priors)[ROW_LENGTH]);
+
+
+/**
+ * A policy for the PUCT selection of the MCTS algorithm, from the loaded network (see 'set_MCTS_policy').
+ * The priors are uniform over the valid moves if no network is loaded.
+ *
+ * @param game the position, not finished. Is assumed non-null.
+ * @param priors filled with the probability of each move ; 0 for the invalid moves.
+*/
+void network_policy(game_t* game, float priors[ROW_LENGTH]);
+
+
+/**
+ * Frees the loaded network, if any.
+*/
+void free_network();
+
+
+#endif /* NETWORK_H */
@@ -0,0 +1,29 @@
+#ifndef PLAYOUT_H
+#define PLAYOUT_H
+
+
+#include <stdint.h>
+#include "./game_manager.h"
+
+
+#define PLAYOUT_LANES 4    // number of boards advanced together by the vectorised kernel (64-bit lanes of an AVX2 register)
+
+
+/**
+ * Runs one random playout from each of the given states. All moves are random amongst the valid ones.
+ * The boards are advanced PLAYOUT_LANES at a time, in lockstep, on the bitboards of the states (with AVX2 if available
+ * and the bitboards are 64-bit, one board at a time otherwise). The states are NOT modified.
+ *
+ * @param states the initial states of the playouts. They are assumed non-null, and may be already finished.
+ * The same state may appear several times to run several playouts from it.
+ * @param nb_states the number of states
+ * @param player the player for which the wins are counted. Must be PLAYER_A or PLAYER_B
+ * @param seed the seed of the random moves
+ * @param results filled with 1 if the playout from states[i] results in a win for 'player'; 0 if it results in a loss or a draw
+ *
+ * @returns the number of playouts won by 'player'
+*/
+uint32_t run_playouts(game_t* const* states, uint32_t nb_states, player_t player, uint64_t seed, uint8_t* results);
+
+
+#endif /* PLAYOUT_H */
\ No newline at end of file
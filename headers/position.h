@@ -0,0 +1,85 @@
+#ifndef POSITION_H
+#define POSITION_H
+
+
+#include <stdint.h>
+#include "./game_manager.h"
+
+
+#define POSITION_COLUMN (COL_HEIGHT+1)    // bits per column, including the sentinel bit above the top cell
+
+_Static_assert(ROW_LENGTH*POSITION_COLUMN <= 8*sizeof(bitboard_t), "the positions must fit in a bitboard");
+
+
+/**
+ * A compact alternative to game_t, in two bitboards (64-bit words up to 8x7), for the searches which copy many positions.
+ * The cells are stored column by column : the cell (col, row) is the bit col*POSITION_COLUMN + row, and the bit above
+ * the top cell of each column (the sentinel) is always 0, so that the shifts used to detect the winning rows don't
+ * wrap from one column to the next.
+ * - 'mask' has the bits of all the disks of the board ;
+ * - 'current' has the bits of the disks of the player to move.
+ * Everything else is derived by bit operations : the player to move from the parity of the number of disks, the height
+ * of a column from its bits in 'mask', the disks of the other player as 'current ^ mask'.
+ * A position doesn't record whether the game is won : 'position_play' tells it when the winning move is played.
+*/
+typedef struct position {
+    bitboard_t current;
+    bitboard_t mask;
+} position_t;
+
+
+/**
+ * Returns the position at the start of a game.
+*/
+position_t position_init();
+
+
+/**
+ * Converts a game to a position.
+ *
+ * @param game the game. Is assumed non-null.
+ *
+ * @returns the position of the disks of 'game'
+*/
+position_t position_from_game(game_t* game);
+
+
+/**
+ * Returns the player whose turn it is in a position.
+*/
+player_t position_now_playing(position_t position);
+
+
+/**
+ * Returns the number of disks in a column of a position.
+*/
+int8_t position_height(position_t position, col_t col);
+
+
+/**
+ * Returns the mask of the columns which are not full : bit 'col' is set if a disk can be played in the column 'col'.
+*/
+uint16_t position_legal_moves(position_t position);
+
+
+/**
+ * Returns whether the board of a position is full.
+*/
+boolean position_is_full(position_t position);
+
+
+/**
+ * Plays a move in a position for the player whose turn it is.
+ *
+ * @param position the position, updated if the move is valid. Is assumed non-null and not finished.
+ * @param col the column in which the disk is played. Must be contained in [0, ROW_LENGTH[.
+ *
+ * @returns 2 if the move is valid and results in a draw;
+ * 1 if the move is valid and results in a win for the player who played it;
+ * 0 if the move is valid;
+ * -2 if the column is full.
+*/
+int8_t position_play(position_t* position, col_t col);
+
+
+#endif /* POSITION_H */
@@ -0,0 +1,106 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+
+#include <stdint.h>
+#include "./game_manager.h"
+
+
+#define POOL_MAX_WORKERS 64
+#define POOL_DEQUE_CAPACITY 1024    // tasks waiting in the deque of one worker
+#define POOL_ERROR -61
+
+
+/**
+ * A function run by the pool, with its argument.
+*/
+typedef void (*task_function_t)(void* arg);
+
+
+/**
+ * A set of tasks which can be waited for together. Must be zero-initialised before its first task is submitted.
+*/
+typedef struct task_group {
+    uint32_t pending;    // number of tasks submitted and not finished yet
+} task_group_t;
+
+
+/**
+ * The activity of one worker of the pool since the pool was started or its counters were reset.
+*/
+typedef struct worker_counters {
+    uint64_t tasks;            // number of tasks run
+    uint64_t steals;           // number of tasks taken from the deque of another worker
+    uint64_t failed_steals;    // number of deques found empty when looking for a task to steal
+    uint64_t idle_ns;          // time spent looking for a task or sleeping
+} worker_counters_t;
+
+
+/*
+The pool is a work-stealing scheduler. Each worker has its own deque of tasks : it pushes and pops the tasks it submits
+at the bottom of its deque, and takes the oldest task at the top of the deque of another worker when its own is empty.
+The tasks submitted by a thread outside of the pool are dealt to the workers in turn. The workers thus never contend
+on a shared queue, and only meet when one steals from another.
+There is one pool per process : the functions below are not meant to be called concurrently, except for 'pool_submit'
+and 'pool_wait' which may be called from inside the tasks.
+*/
+
+
+/**
+ * Starts the worker threads of the pool. Does nothing if the pool is already running with the same number of workers,
+ * and restarts it otherwise.
+ *
+ * @param nb_workers the number of worker threads, in [1, POOL_MAX_WORKERS]
+ * @param pin whether each worker is pinned to its own CPU (worker i on CPU (i+1) modulo the number of CPUs, leaving CPU 0
+ * to the thread which started the pool)
+ *
+ * @returns the number of workers running;
+ * ARG_ERROR if the arguments are invalid;
+ * POOL_ERROR if no thread could be started.
+*/
+int8_t pool_start(uint8_t nb_workers, boolean pin);
+
+
+/**
+ * Returns the number of workers running, 0 if the pool is stopped.
+*/
+uint8_t pool_size();
+
+
+/**
+ * Submits a task to the pool. If the deque of the chosen worker is full, the task is run immediately by the caller.
+ *
+ * @param group the group of the task. Is assumed non-null.
+ * @param function the function to run
+ * @param arg the argument of the function
+*/
+void pool_submit(task_group_t* group, task_function_t function, void* arg);
+
+
+/**
+ * Waits until all the tasks of a group are finished. The calling thread runs tasks of the pool meanwhile,
+ * so a task may wait for the tasks it submitted.
+ *
+ * @param group the group to wait for
+*/
+void pool_wait(task_group_t* group);
+
+
+/**
+ * Copies the counters of each worker, and resets them if requested.
+ *
+ * @param counters filled with the counters of each worker. Must have room for pool_size() elements.
+ * @param reset whether the counters are reset after being copied
+ *
+ * @returns the number of workers whose counters were copied
+*/
+uint8_t pool_counters(worker_counters_t* counters, boolean reset);
+
+
+/**
+ * Stops the worker threads of the pool, once the tasks already submitted are finished.
+*/
+void pool_stop();
+
+
+#endif /* THREAD_POOL_H */
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../headers/engine_process.h"
+
+
+/*
+Self-play arena : two MCTS configurations X and Y play a series of games against each other, with alternating colours
+and random openings. Each opening is played twice, once with each colour assignment.
+The games are spread over several worker processes, and each AI runs in its own process.
+
+Usage : ./out_arena nb_games nb_jobs visits_X exploration_X visits_Y exploration_Y [opening_plies [seed]]
+*/
+
+
+#define X 0
+#define Y 1
+
+
+/**
+ * The result of a game, as sent by a worker process to the main process.
+*/
+typedef struct game_result {
+    int8_t outcome;    // 1 if X won, -1 if Y won, 0 if the game is a draw, ENGINE_ERROR if the game could not be played
+    uint32_t nb_moves[2];    // number of moves decided by the MCTS of X and Y
+    uint64_t think_ns[2];    // total time spent by X and Y to decide their moves
+} game_result_t;
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+/**
+ * Plays random moves at the start of a game. The moves never end the game.
+ *
+ * @param game the game in which to play the opening. Is assumed to be a new game.
+ * @param opening filled with the columns of the opening moves
+ * @param opening_length the number of moves to play
+*/
+static void play_random_opening(game_t* game, col_t* opening, uint8_t opening_length) {
+    for (uint8_t i = 0; i < opening_length; i++) {
+        col_t col;
+        do col = random() % ROW_LENGTH;
+        while (play_auto_without_update(game, col) != 0);
+        play_auto(game, col);
+        opening[i] = col;
+    }
+}
+
+
+/**
+ * Plays one game between X and Y.
+ *
+ * @param game_index the index of the game. Both the opening and the colours depend on it.
+ * @param configs the configurations of X and Y
+ * @param opening_length the number of random moves played before the AIs start playing
+ * @param seed the seed of the series of games
+ *
+ * @returns the result of the game
+*/
+static game_result_t play_game(uint32_t game_index, engine_config_t configs[2], uint8_t opening_length, uint32_t seed) {
+    game_result_t result = {ENGINE_ERROR, {0, 0}, {0, 0}};
+    game_t* game = game_init();
+    if (game == NULL) return result;
+
+    // Both games of a pair share the same opening, with swapped colours
+    col_t opening[COL_HEIGHT*ROW_LENGTH];
+    srandom(seed + game_index/2);
+    play_random_opening(game, opening, opening_length);
+
+    player_t x_plays_as = (game_index % 2 == 0) ? PLAYER_A : PLAYER_B;
+    uint8_t first_ai = (now_playing(game) == x_plays_as) ? X : Y;
+    uint8_t second_ai = 1-first_ai;
+
+    // The AI which doesn't play first is started first : it doesn't search anything before the first move
+    engine_process_t engines[2] = {ENGINE_STOPPED, ENGINE_STOPPED};
+    uint64_t think_ns;
+    player_t second_plays_as = (second_ai == X) ? x_plays_as : 1-x_plays_as;
+    if (engine_start(&engines[second_ai], configs[second_ai], second_plays_as, opening, opening_length,
+            seed ^ (2*game_index+1), NULL) != ROW_LENGTH) {
+        engine_stop(&engines[second_ai]);    // it may run and have answered with an error
+        game_destroy(game);
+        return result;
+    }
+    col_t col = engine_start(&engines[first_ai], configs[first_ai], 1-second_plays_as, opening, opening_length,
+            seed ^ (2*game_index+2), &think_ns);
+
+    uint8_t ai = first_ai;
+    while (col >= 0 && col < ROW_LENGTH) {
+        result.nb_moves[ai]++;
+        result.think_ns[ai] += think_ns;
+        int8_t move_res = play_auto(game, col);
+        if (move_res < 0) break;    // the AI played an invalid move
+        if (move_res == 1) {
+            result.outcome = (ai == X) ? 1 : -1;
+            break;
+        }
+        if (move_res == 2) {
+            result.outcome = 0;
+            break;
+        }
+        ai = 1-ai;
+        col = engine_input(&engines[ai], col, &think_ns);
+    }
+
+    engine_stop(&engines[X]);
+    engine_stop(&engines[Y]);
+    game_destroy(game);
+    return result;
+}
+
+
+/**
+ * The main function of a worker process : plays the games whose index is congruent to 'worker' modulo 'nb_jobs',
+ * and sends their results through a pipe. Never returns.
+*/
+static void worker_main(int to_parent, uint8_t worker, uint8_t nb_jobs, uint32_t nb_games,
+        engine_config_t configs[2], uint8_t opening_length, uint32_t seed) {
+    for (uint32_t game_index = worker; game_index < nb_games; game_index += nb_jobs) {
+        game_result_t result = play_game(game_index, configs, opening_length, seed);
+        if (write(to_parent, &result, sizeof(result)) != sizeof(result)) _exit(-1);
+    }
+    _exit(0);
+}
+
+
+/**
+ * Converts an expected score into an Elo difference.
+*/
+static double score_to_elo(double score) {
+    if (score <= 0.0) return -INFINITY;
+    if (score >= 1.0) return INFINITY;
+    return -400.0 * log10(1.0/score - 1.0);
+}
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 7 || argc > 9) {
+        fprintf(stderr, "Usage : %s nb_games nb_jobs visits_X exploration_X visits_Y exploration_Y [opening_plies [seed]]\n", argv[0]);
+        exit(-1);
+    }
+    uint32_t nb_games = atoi(argv[1]);
+    uint8_t nb_jobs = atoi(argv[2]);
+    engine_config_t configs[2] = {
+        {atoi(argv[3]), atof(argv[4])},
+        {atoi(argv[5]), atof(argv[6])}
+    };
+    uint8_t opening_length = (argc >= 8) ? atoi(argv[7]) : 2;
+    uint32_t seed = (argc == 9) ? (uint32_t) atoi(argv[8]) : (uint32_t) time(NULL);
+    if (nb_games == 0 || nb_jobs == 0 || opening_length >= 2*CONNECT_N-1) exit(-1);    // 2*CONNECT_N-1 moves may already end the game
+    if (nb_jobs > nb_games) nb_jobs = nb_games;
+
+    printf("X : %u visits, exploration %.2f\n", configs[X].max_visits, configs[X].exploration);
+    printf("Y : %u visits, exploration %.2f\n", configs[Y].max_visits, configs[Y].exploration);
+    printf("%u games, %u jobs, %u random opening moves, seed %u\n\n", nb_games, nb_jobs, opening_length, seed);
+    fflush(stdout);
+
+    signal(SIGPIPE, SIG_IGN);    // a crashed AI process must not kill its worker
+    int results_pipe[2];
+    if (pipe(results_pipe) != 0) exit(-1);
+    for (uint8_t worker = 0; worker < nb_jobs; worker++) {
+        pid_t pid = fork();
+        if (pid < 0) exit(-1);
+        if (pid == 0) {
+            close(results_pipe[0]);
+            worker_main(results_pipe[1], worker, nb_jobs, nb_games, configs, opening_length, seed);
+        }
+    }
+    close(results_pipe[1]);
+
+    // Gathering the results
+    uint32_t wins = 0, draws = 0, losses = 0, errors = 0;
+    uint32_t nb_moves[2] = {0, 0};
+    uint64_t think_ns[2] = {0, 0};
+    game_result_t result;
+    while (read(results_pipe[0], &result, sizeof(result)) == sizeof(result)) {
+        switch (result.outcome) {
+            case 1: wins++; break;
+            case 0: draws++; break;
+            case -1: losses++; break;
+            default: errors++;
+        }
+        for (uint8_t ai = X; ai <= Y; ai++) {
+            nb_moves[ai] += result.nb_moves[ai];
+            think_ns[ai] += result.think_ns[ai];
+        }
+        printf("\r%u / %u games played", wins+draws+losses+errors, nb_games);
+        fflush(stdout);
+    }
+    close(results_pipe[0]);
+    while (wait(NULL) > 0);
+    printf("\n\n");
+
+    uint32_t nb_played = wins + draws + losses;
+    printf("X wins / draws / losses : %u / %u / %u", wins, draws, losses);
+    if (errors > 0) printf(" (%u games failed)", errors);
+    printf("\n");
+    if (nb_played == 0) exit(-1);
+
+    // Elo difference, with a 95 % confidence interval from the standard error of the score
+    double score = (wins + 0.5*draws) / nb_played;
+    double variance = (wins * pow(1.0-score, 2) + draws * pow(0.5-score, 2) + losses * pow(score, 2)) / nb_played;
+    double margin = 1.96 * sqrt(variance / nb_played);
+    printf("Score of X : %.3f\n", score);
+    printf("Elo difference (X - Y) : %+.1f [%+.1f, %+.1f] (95 %%)\n",
+            score_to_elo(score), score_to_elo(score - margin), score_to_elo(score + margin));
+
+    for (uint8_t ai = X; ai <= Y; ai++)
+        printf("Average think time of %c : %.2f ms per move\n", (ai == X) ? 'X' : 'Y',
+                (nb_moves[ai] > 0) ? think_ns[ai] / 1e6 / nb_moves[ai] : 0.0);
+}
@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+Micro-benchmarks of the hot paths of the game and of the MCTS algorithm.
+The sources are included directly so that their static functions can be measured.
+
+Each case is measured as a series of samples. A sample times a batch of operations and records the average time
+of one operation in the batch. The median and the 99th percentile of the samples are reported, along with the
+number of operations per second at the median.
+
+Usage : ./out_bench [case]    (runs all the cases whose name starts with 'case', or all of them)
+*/
+#include "game_manager.c"
+#include "playout.c"
+#include "mcts.c"
+#include "../headers/network.h"
+#include "../headers/position.h"
+
+
+#define NB_GAMES 256    // number of random games used as inputs by the game cases
+#define MAX_MOVES (ROW_LENGTH*COL_HEIGHT)
+#define BENCH_NETWORK_HIDDEN 128    // size of the hidden layer of the random network of the network case
+
+
+/**
+ * A random game, and the states reached after each of its moves.
+*/
+typedef struct recorded_game {
+    uint8_t nb_moves;
+    col_t moves[MAX_MOVES];
+    game_t states[MAX_MOVES];    // states[i] is the state after moves[i]
+} recorded_game_t;
+
+static recorded_game_t games[NB_GAMES];
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * Prints the statistics of the samples of a benchmark case. The samples are sorted in place.
+ *
+ * @param name the name of the case
+ * @param samples the average time of one operation (in nanoseconds) in each sample
+ * @param nb_samples the number of samples
+*/
+static void report(const char* name, double* samples, uint32_t nb_samples) {
+    qsort(samples, nb_samples, sizeof(double), compare_doubles);
+    double median = samples[nb_samples/2];
+    double p99 = samples[(uint32_t) ((nb_samples-1) * 0.99)];
+    printf("%-28s %14.1f %14.1f %14.0f\n", name, median, p99, 1e9/median);
+    fflush(stdout);
+}
+
+
+/**
+ * Fills 'games' with random games played until their end.
+*/
+static void record_random_games() {
+    for (uint32_t g = 0; g < NB_GAMES; g++) {
+        game_t* game = game_init();
+        recorded_game_t* rec = &games[g];
+        rec->nb_moves = 0;
+        int8_t res = 0;
+        while (res == 0) {
+            col_t col;
+            do {
+                col = random() % ROW_LENGTH;
+                res = play_auto(game, col);
+            } while (res == -2);
+            rec->moves[rec->nb_moves] = col;
+            rec->states[rec->nb_moves] = *game;
+            rec->nb_moves++;
+        }
+        game_destroy(game);
+    }
+}
+
+
+/**
+ * Builds a fresh tree in tree_root and runs MCTS iterations until its root has at least 'nb_visits' visits.
+*/
+static void grow_tree(uint32_t nb_visits) {
+    tree_root = create_fresh_tree();
+    while (node_visits(tree_root) < nb_visits) {
+        node_t* selected = MCTS_selection(tree_root);
+        MCTS_expansion_simulation(selected);
+        MTCS_backpropagation(selected);
+    }
+}
+
+
+/**
+ * Returns whether the statistics of a tree are consistent once no search runs on it : no node has more wins than visits,
+ * nor more visits than its parent. A virtual loss removed from statistics which were overwritten in the meantime breaks it.
+*/
+static boolean is_consistent(node_t* node) {
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        node_t* child = child_of(node, col);
+        if (child == NULL) continue;
+        packed_stats_t packed = load_stats(child);
+        if (packed_wins(packed) > packed_visits(packed) || packed_visits(packed) > node_visits(node)) return 0;
+        if (!is_consistent(child)) return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * Writes a weights file of a network with random weights, in the format read by load_network.
+ *
+ * @returns 0 on success;
+ * -1 if the file can't be written
+*/
+static int8_t write_random_network(const char* path, uint16_t nb_hidden) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return -1;
+    const char magic[4] = {'C', '4', 'N', 'N'};
+    uint8_t version = 1, hidden_shift = 4;
+    float output_scale = 1.0f / 4096;
+    fwrite(magic, sizeof(char), 4, file);
+    fwrite(&version, sizeof(uint8_t), 1, file);
+    fwrite(&hidden_shift, sizeof(uint8_t), 1, file);
+    fwrite(&nb_hidden, sizeof(uint16_t), 1, file);
+    fwrite(&output_scale, sizeof(float), 1, file);
+    for (uint32_t i = 0; i < (NETWORK_INPUTS+1) * nb_hidden; i++) {
+        int16_t weight = random() % 512 - 256;
+        fwrite(&weight, sizeof(int16_t), 1, file);
+    }
+    for (uint32_t i = 0; i < NETWORK_OUTPUTS * nb_hidden; i++) {
+        int8_t weight = random() % 256 - 128;
+        fwrite(&weight, sizeof(int8_t), 1, file);
+    }
+    for (uint8_t o = 0; o < NETWORK_OUTPUTS; o++) {
+        int32_t bias = random() % 4096 - 2048;
+        fwrite(&bias, sizeof(int32_t), 1, file);
+    }
+    return (fclose(file) == 0) ? 0 : -1;
+}
+
+
+/*
+===========================================
+================== CASES ==================
+===========================================
+*/
+
+
+static void bench_play(uint32_t nb_samples) {
+    double samples[nb_samples];
+    volatile grid_t sink = 0;
+    game_t* init_game = game_init();
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t nb_ops = 0;
+        uint64_t start = now_ns();
+        for (uint32_t g = 0; g < NB_GAMES; g++) {
+            game_t game = *init_game;
+            for (uint8_t m = 0; m < games[g].nb_moves; m++) play_auto(&game, games[g].moves[m]);
+            sink = game.gridA;
+            nb_ops += games[g].nb_moves;
+        }
+        samples[s] = (double) (now_ns() - start) / nb_ops;
+    }
+    game_destroy(init_game);
+    (void) sink;
+    report("play", samples, nb_samples);
+}
+
+
+static void bench_play_unchecked(uint32_t nb_samples) {
+    double samples[nb_samples];
+    volatile grid_t sink = 0;
+    game_t* init_game = game_init();
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t nb_ops = 0;
+        uint64_t start = now_ns();
+        for (uint32_t g = 0; g < NB_GAMES; g++) {
+            game_t game = *init_game;
+            for (uint8_t m = 0; m < games[g].nb_moves; m++) play_unchecked(&game, games[g].moves[m]);
+            sink = game.gridA;
+            nb_ops += games[g].nb_moves;
+        }
+        samples[s] = (double) (now_ns() - start) / nb_ops;
+    }
+    game_destroy(init_game);
+    (void) sink;
+    report("play_unchecked", samples, nb_samples);
+}
+
+
+static void bench_position_play(uint32_t nb_samples) {
+    double samples[nb_samples];
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t nb_ops = 0;
+        uint64_t start = now_ns();
+        for (uint32_t g = 0; g < NB_GAMES; g++) {
+            position_t position = position_init();
+            for (uint8_t m = 0; m < games[g].nb_moves; m++) position_play(&position, games[g].moves[m]);
+            nb_ops += games[g].nb_moves;
+        }
+        samples[s] = (double) (now_ns() - start) / nb_ops;
+    }
+    report("position_play", samples, nb_samples);
+}
+
+
+static void bench_winner(uint32_t nb_samples) {
+    double samples[nb_samples];
+    volatile player_t sink = 0;
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t nb_ops = 0;
+        uint64_t start = now_ns();
+        for (uint32_t g = 0; g < NB_GAMES; g++) {
+            for (uint8_t m = 0; m < games[g].nb_moves; m++) sink = winner(&games[g].states[m]);
+            nb_ops += games[g].nb_moves;
+        }
+        samples[s] = (double) (now_ns() - start) / nb_ops;
+    }
+    (void) sink;
+    report("winner", samples, nb_samples);
+}
+
+
+static void bench_winning_columns(uint32_t nb_samples) {
+    double samples[nb_samples];
+    volatile uint8_t sink = 0;
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t nb_ops = 0;
+        uint64_t start = now_ns();
+        for (uint32_t g = 0; g < NB_GAMES; g++) {
+            for (uint8_t m = 0; m < games[g].nb_moves; m++) sink = winning_columns(&games[g].states[m], m % 2);
+            nb_ops += games[g].nb_moves;
+        }
+        samples[s] = (double) (now_ns() - start) / nb_ops;
+    }
+    (void) sink;
+    report("winning_columns", samples, nb_samples);
+}
+
+
+static void bench_evaluate(uint32_t nb_samples) {
+    double samples[nb_samples];
+    volatile float sink = 0;
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t nb_ops = 0;
+        uint64_t start = now_ns();
+        for (uint32_t g = 0; g < NB_GAMES; g++) {
+            for (uint8_t m = 0; m < games[g].nb_moves; m++) sink = evaluate(&games[g].states[m], PLAYER_A);
+            nb_ops += games[g].nb_moves;
+        }
+        samples[s] = (double) (now_ns() - start) / nb_ops;
+    }
+    (void) sink;
+    report("evaluate", samples, nb_samples);
+}
+
+
+static void bench_network(uint32_t nb_samples) {
+    const char* path = "bench_network.tmp";
+    boolean loaded = (write_random_network(path, BENCH_NETWORK_HIDDEN) == 0 && load_network(path) == 0);
+    remove(path);
+    if (!loaded) {
+        fprintf(stderr, "network : the random network could not be loaded\n");
+        return;
+    }
+
+    // The positions of the random games, evaluated in batches of the size of an expansion of 8 leaves
+    const uint32_t batch = 8*ROW_LENGTH;
+    game_t* states[batch];
+    float values[batch];
+    float priors[batch][ROW_LENGTH];
+    double samples[nb_samples];
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t nb_ops = 0;
+        uint64_t start = now_ns();
+        for (uint32_t g = 0; g < NB_GAMES; g++) {
+            uint32_t nb_states = 0;
+            for (uint8_t m = 0; m < games[g].nb_moves && nb_states < batch; m++) states[nb_states++] = &games[g].states[m];
+            network_evaluate(states, nb_states, values, priors);
+            nb_ops += nb_states;
+        }
+        samples[s] = (double) (now_ns() - start) / nb_ops;
+    }
+    free_network();
+    report("network", samples, nb_samples);
+}
+
+
+static void bench_playout(uint32_t nb_samples) {
+    const uint32_t batch = 1000;
+    double samples[nb_samples];
+    game_t* init_game = game_init();
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t start = now_ns();
+        for (uint32_t i = 0; i < batch; i++) MTCS_simulation(init_game);
+        samples[s] = (double) (now_ns() - start) / batch;
+    }
+    game_destroy(init_game);
+    report("playout", samples, nb_samples);
+}
+
+
+static void bench_batch_playout(uint32_t nb_samples) {
+    const uint32_t batch = 1024;
+    double samples[nb_samples];
+    game_t* init_game = game_init();
+    game_t* states[batch];
+    uint8_t results[batch];
+    for (uint32_t i = 0; i < batch; i++) states[i] = init_game;
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t start = now_ns();
+        run_playouts(states, batch, PLAYER_A, s, results);
+        samples[s] = (double) (now_ns() - start) / batch;
+    }
+    game_destroy(init_game);
+    report("batch_playout", samples, nb_samples);
+}
+
+
+static void bench_MCTS_iteration(uint32_t nb_samples, uint32_t tree_visits) {
+    const uint32_t batch = 100;
+    double samples[nb_samples];
+    grow_tree(tree_visits);
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        uint64_t start = now_ns();
+        for (uint32_t i = 0; i < batch; i++) {
+            node_t* selected = MCTS_selection(tree_root);
+            MCTS_expansion_simulation(selected);
+            MTCS_backpropagation(selected);
+        }
+        samples[s] = (double) (now_ns() - start) / batch;
+    }
+    destroy_MCTS();
+
+    char name[32];
+    snprintf(name, sizeof(name), "MCTS_iteration (%uk)", tree_visits/1000);
+    report(name, samples, nb_samples);
+}
+
+
+/**
+ * Times the searches of fresh trees up to 'tree_visits' visits, with the given threads, per iteration. Exits if a search
+ * leaves inconsistent statistics.
+*/
+static void bench_threaded_search(uint32_t nb_samples, uint8_t search_threads, uint8_t simulation_threads, uint32_t tree_visits) {
+    double samples[nb_samples];
+    set_MCTS_search_threads(search_threads);
+    set_MCTS_simulation_threads(simulation_threads);
+    MAX_VISITS = tree_visits;
+    search_goal = tree_visits - ROW_LENGTH;
+    uint8_t nb_workers = ((search_threads > simulation_threads) ? search_threads : simulation_threads) - 1;
+    if (nb_workers > 0) pool_start(nb_workers, PIN_THREADS);
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        search_stats_t empty_stats = {0};
+        stats = empty_stats;
+        tree_root = create_fresh_tree();
+        uint64_t start = now_ns();
+        if (search_threads > 1) parallel_search();
+        else sequential_search();
+        samples[s] = (double) (now_ns() - start) / stats.iterations;
+        if (!is_consistent(tree_root)) {
+            fprintf(stderr, "Inconsistent statistics after a search with %u search and %u simulation threads\n",
+                    search_threads, simulation_threads);
+            exit(1);
+        }
+        destroy_MCTS();
+        if (nb_workers > 0) pool_start(nb_workers, PIN_THREADS);    // destroy_MCTS stops the pool
+    }
+    pool_stop();
+    set_MCTS_search_threads(1);
+    set_MCTS_simulation_threads(1);
+
+    char name[40];
+    snprintf(name, sizeof(name), "search (%u+%u threads, %uk)", search_threads, simulation_threads, tree_visits/1000);
+    report(name, samples, nb_samples);
+}
+
+
+static void bench_progress_in_tree(uint32_t nb_samples, uint32_t tree_visits) {
+    double samples[nb_samples];
+    for (uint32_t s = 0; s < nb_samples; s++) {
+        grow_tree(tree_visits);
+        uint64_t start = now_ns();
+        progress_in_tree(s % ROW_LENGTH);
+        samples[s] = (double) (now_ns() - start);
+        destroy_MCTS();
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "progress_in_tree (%uk)", tree_visits/1000);
+    report(name, samples, nb_samples);
+}
+
+
+static boolean is_selected(const char* name, const char* filter) {
+    return filter == NULL || strncmp(name, filter, strlen(filter)) == 0;
+}
+
+
+int main(int argc, char* argv[]) {
+    const char* filter = (argc >= 2) ? argv[1] : NULL;
+    srandom(42);
+    record_random_games();
+
+    printf("%-28s %14s %14s %14s\n", "case", "median (ns)", "p99 (ns)", "ops/s");
+    if (is_selected("play", filter)) bench_play(101);
+    if (is_selected("play_unchecked", filter)) bench_play_unchecked(101);
+    if (is_selected("position_play", filter)) bench_position_play(101);
+    if (is_selected("winner", filter)) bench_winner(101);
+    if (is_selected("winning_columns", filter)) bench_winning_columns(101);
+    if (is_selected("evaluate", filter)) bench_evaluate(101);
+    if (is_selected("network", filter)) bench_network(101);
+    if (is_selected("playout", filter)) bench_playout(101);
+    if (is_selected("batch_playout", filter)) bench_batch_playout(101);
+    if (is_selected("MCTS_iteration", filter)) {
+        bench_MCTS_iteration(101, 1000);
+        bench_MCTS_iteration(101, 10000);
+        bench_MCTS_iteration(101, 100000);
+    }
+    if (is_selected("progress_in_tree", filter)) bench_progress_in_tree(21, 20000);
+    if (is_selected("search", filter)) {
+        bench_threaded_search(11, 1, 1, 20000);
+        bench_threaded_search(11, 1, 4, 20000);
+        bench_threaded_search(11, 4, 1, 20000);
+        bench_threaded_search(11, 4, 4, 20000);
+    }
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../headers/engine_process.h"
+#include "../headers/mcts.h"
+
+
+/**
+ * The message sent by an AI process after each of its decisions.
+*/
+typedef struct engine_reply {
+    col_t col;
+    uint64_t think_ns;
+} engine_reply_t;
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Reads or writes exactly 'size' bytes through a pipe.
+ *
+ * @returns 0 on success;
+ * -1 if the pipe was closed or in case of error.
+*/
+static int8_t read_all(int fd, void* buffer, size_t size) {
+    for (size_t done = 0; done < size; ) {
+        ssize_t n = read(fd, (char*) buffer + done, size - done);
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+static int8_t write_all(int fd, const void* buffer, size_t size) {
+    for (size_t done = 0; done < size; ) {
+        ssize_t n = write(fd, (const char*) buffer + done, size - done);
+        if (n <= 0) return -1;
+        done += n;
+    }
+    return 0;
+}
+
+
+/**
+ * The main loop of an AI process. Never returns.
+*/
+static void engine_main(int from_parent, int to_parent, engine_config_t config, player_t playing_as,
+        const col_t* opening, uint8_t opening_length, uint32_t seed) {
+    // MCTS prints debug information on the standard output : it is not wanted in an AI process
+    if (freopen("/dev/null", "w", stdout) == NULL) _exit(-1);
+    srandom(seed);
+    set_MCTS_exploration(config.exploration);
+
+    engine_reply_t reply;
+    uint64_t start = now_ns();
+    reply.col = init_MCTS_from_opening(playing_as, config.max_visits, opening, opening_length);
+    reply.think_ns = now_ns() - start;
+    if (write_all(to_parent, &reply, sizeof(reply)) != 0) _exit(-1);
+
+    col_t col;
+    while (read_all(from_parent, &col, sizeof(col)) == 0) {
+        start = now_ns();
+        reply.col = input_MCTS(col);
+        reply.think_ns = now_ns() - start;
+        if (write_all(to_parent, &reply, sizeof(reply)) != 0) break;
+    }
+    destroy_MCTS();
+    _exit(0);
+}
+
+
+/**
+ * Waits for the next decision of an AI.
+*/
+static col_t read_reply(engine_process_t* engine, uint64_t* think_ns) {
+    engine_reply_t reply;
+    if (read_all(engine->from_engine, &reply, sizeof(reply)) != 0) return ENGINE_ERROR;
+    if (think_ns != NULL) *think_ns = reply.think_ns;
+    return reply.col;
+}
+
+
+/*
+===========================================
+=================== API ===================
+===========================================
+*/
+
+
+col_t engine_start(engine_process_t* engine, engine_config_t config, player_t playing_as,
+        const col_t* opening, uint8_t opening_length, uint32_t seed, uint64_t* think_ns) {
+    engine_process_t stopped = ENGINE_STOPPED;
+    *engine = stopped;
+    int to_engine[2], from_engine[2];
+    if (pipe(to_engine) != 0) return ENGINE_ERROR;
+    if (pipe(from_engine) != 0) {
+        close(to_engine[0]);
+        close(to_engine[1]);
+        return ENGINE_ERROR;
+    }
+    fflush(stdout);    // otherwise, the buffered output would be printed by both processes
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(to_engine[0]);
+        close(to_engine[1]);
+        close(from_engine[0]);
+        close(from_engine[1]);
+        return ENGINE_ERROR;
+    }
+    if (pid == 0) {
+        // Closes all the other inherited descriptors (e.g. the pipes of other AIs), so that they still see the end
+        // of their pipes when their parent closes them
+        long max_fd = sysconf(_SC_OPEN_MAX);
+        if (max_fd < 0 || max_fd > 4096) max_fd = 4096;
+        for (int fd = STDERR_FILENO+1; fd < max_fd; fd++)
+            if (fd != to_engine[0] && fd != from_engine[1]) close(fd);
+        engine_main(to_engine[0], from_engine[1], config, playing_as, opening, opening_length, seed);
+    }
+
+    close(to_engine[0]);
+    close(from_engine[1]);
+    engine->pid = pid;
+    engine->to_engine = to_engine[1];
+    engine->from_engine = from_engine[0];
+    col_t first_move = read_reply(engine, think_ns);
+    if (first_move == ENGINE_ERROR) engine_stop(engine);
+    return first_move;
+}
+
+
+col_t engine_input(engine_process_t* engine, col_t col, uint64_t* think_ns) {
+    if (write_all(engine->to_engine, &col, sizeof(col)) != 0) return ENGINE_ERROR;
+    return read_reply(engine, think_ns);
+}
+
+
+void engine_stop(engine_process_t* engine) {
+    if (engine->pid < 0) return;
+    close(engine->to_engine);    // the AI process terminates when its input pipe is closed
+    close(engine->from_engine);
+    waitpid(engine->pid, NULL, 0);
+    engine_process_t stopped = ENGINE_STOPPED;
+    *engine = stopped;
+}
@@ -0,0 +1,119 @@
+#include <math.h>
+#include <pthread.h>
+#include "../headers/evaluation.h"
+
+
+/*
+The evaluation works on the padded bitboards of the game manager (see 'pad_grid').
+*/
+
+#define THREAT_VALUE 1.0f               // value of a threat on the wrong parity
+#define GOOD_THREAT_VALUE 2.5f          // value of a threat on the rows of the right parity
+#define CENTRE_VALUE 0.15f              // value of a disk per winning row of cells crossing its column
+#define IMMEDIATE_WIN_VALUE 0.97f       // value of a position where the player to move can win at once
+#define EVALUATION_SCALE 3.0f           // difference of scores between the players making a 73% winning chance
+#define POLICY_TEMPERATURE 0.1f         // temperature of the softmax of heuristic_policy
+
+
+/**
+ * The constant bitboards of the evaluation.
+*/
+typedef struct evaluation_masks {
+    bitboard_t board;        // all the cells of the board
+    bitboard_t bottom_row;
+    bitboard_t odd_rows;     // the rows 1, 3, 5... counted from 1 at the bottom
+    bitboard_t columns[ROW_LENGTH];
+    float column_weights[ROW_LENGTH];    // the number of horizontal rows of CONNECT_N cells crossing each column
+} evaluation_masks_t;
+
+static evaluation_masks_t masks;
+static pthread_once_t masks_once = PTHREAD_ONCE_INIT;    // the masks are computed at the first evaluation
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+static void compute_evaluation_masks() {
+    for (int8_t row = 0; row < COL_HEIGHT; row++) {
+        for (col_t col = 0; col < ROW_LENGTH; col++) {
+            bitboard_t bit = (bitboard_t) 1 << (row*PADDED_ROW + ROW_LENGTH-1-col);
+            masks.board |= bit;
+            masks.columns[col] |= bit;
+            if (row == 0) masks.bottom_row |= bit;
+            if (row % 2 == 0) masks.odd_rows |= bit;
+        }
+    }
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        int8_t first = (col-(CONNECT_N-1) > 0) ? col-(CONNECT_N-1) : 0;    // the first and last rows crossing the column
+        int8_t last = (col < ROW_LENGTH-CONNECT_N) ? col : ROW_LENGTH-CONNECT_N;
+        masks.column_weights[col] = (last >= first) ? last - first + 1 : 0;
+    }
+}
+
+
+/**
+ * Scores the threats and the centre control of a player.
+ *
+ * @param disks the padded bitboard of the player
+ * @param threats the padded bitboard of the threats of the player
+ * @param good_rows the rows on which the threats of the player are the most valuable
+*/
+static float score_player(bitboard_t disks, bitboard_t threats, bitboard_t good_rows) {
+    float score = GOOD_THREAT_VALUE * bitboard_popcount(threats & good_rows)
+            + THREAT_VALUE * bitboard_popcount(threats & ~good_rows);
+    for (col_t col = 0; col < ROW_LENGTH; col++)
+        score += CENTRE_VALUE * masks.column_weights[col] * bitboard_popcount(disks & masks.columns[col]);
+    return score;
+}
+
+
+/*
+===========================================
+=================== API ===================
+===========================================
+*/
+
+
+float evaluate(game_t* game, player_t player) {
+    pthread_once(&masks_once, compute_evaluation_masks);
+
+    player_t w = winner(game);
+    if (w == player) return 1.0f;
+    else if (w == DRAW) return 0.5f;
+    else if (w >= 0) return 0.0f;
+
+    bitboard_t mine = pad_grid((player == PLAYER_A) ? game->gridA : game->gridB);
+    bitboard_t theirs = pad_grid((player == PLAYER_A) ? game->gridB : game->gridA);
+    bitboard_t empty = masks.board & ~(mine | theirs);
+
+    // A player to move with a threat in a playable cell wins at once
+    bitboard_t playable = empty & (((mine | theirs) << PADDED_ROW) | masks.bottom_row);
+    player_t mover = now_playing(game);
+    if ((game->threats[mover] & playable) != 0) return (mover == player) ? IMMEDIATE_WIN_VALUE : 1.0f - IMMEDIATE_WIN_VALUE;
+
+    bitboard_t good_rows = (player == PLAYER_A) ? masks.odd_rows : masks.board & ~masks.odd_rows;
+    float difference = score_player(mine, game->threats[player], good_rows)
+            - score_player(theirs, game->threats[1-player], masks.board & ~good_rows);
+    return 1.0f / (1.0f + expf(-difference / EVALUATION_SCALE));
+}
+
+
+void heuristic_policy(game_t* game, float priors[ROW_LENGTH]) {
+    player_t player = now_playing(game);
+    float values[ROW_LENGTH];
+    float max_value = 0.0f, sum = 0.0f;
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        game_t child = *game;
+        values[col] = (play_auto(&child, col) >= 0) ? evaluate(&child, player) : -1.0f;
+        if (values[col] > max_value) max_value = values[col];
+    }
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        priors[col] = (values[col] >= 0) ? expf((values[col] - max_value) / POLICY_TEMPERATURE) : 0.0f;
+        sum += priors[col];
+    }
+    for (col_t col = 0; col < ROW_LENGTH; col++) priors[col] = (sum > 0) ? priors[col] / sum : 0.0f;
+}
@@ -3,8 +3,6 @@
 #include "../headers/game_manager.h"
 
 const grid_t BIT_ONE = (grid_t) 0b1;
-const grid_t TURN_BIT = BIT_ONE<<62;
-const grid_t WIN_BIT = BIT_ONE<<61;
 
 /*
 ===========================================
@@ -26,90 +24,21 @@ static grid_t* get_player_grid(game_t* game, player_t player) {
 
 
 static boolean is_their_turn_to_play(game_t* game, grid_t player_grid) {
-    return (player_grid & TURN_BIT)>>TURN_BIT;
+    return (player_grid & TURN_BIT) != 0;
 }
 
 
 /**
  * Computes the offset of the bit that corresponds to the coordinates (col, row) in the grid
  * 
- * @param col Index of the column. Contained in [0, 6]
- * @param row Index of the row. Contained in [0, 5]. 
+ * @param col Index of the column. Contained in [0, ROW_LENGTH[
+ * @param row Index of the row. Contained in [0, COL_HEIGHT[. 
  */
 static int8_t compute_offset(col_t col, int8_t row) {
     return (1+row)*ROW_LENGTH - col - 1;
 }
 
 
-/**
- * Checks if the addition of the latest added disk creates a Connect-4.
- * The arguments are assumed to be non-NULL pointers or valid numbers.
- * 
- * @param game the state of the game. It is assumed that the latest disk has already been added to the grid and cols_occupation has already been updated.
- * @param col the column (0-6) on which the latest disk was played
- * @param player_grid the grid of the player that added the disk. Includes the latest added disk.
- * 
- * @return 1 if the new disk creates a Connect-4; 0 otherwise
-*/
-static boolean makes_new_connect4(game_t* game, col_t col, grid_t player_grid) {
-    int8_t row_index = game->cols_occupation[col] - 1;
-
-    // Vertical check
-    int8_t consecutive_counter = 0;
-    int8_t init_offset = compute_offset(col, row_index);
-    for (int8_t offset = init_offset; offset >= 0; offset -= ROW_LENGTH) {
-        if ((player_grid & (BIT_ONE<<offset))) consecutive_counter++;
-        else break;
-    }
-    if (consecutive_counter >= 4) return 1;
-
-    //printf("DEBUG : PASSED VERTICAL CHECK\n");
-
-    // Horizontal check
-    consecutive_counter = 0;
-    init_offset = row_index * ROW_LENGTH;
-    for (int8_t offset = init_offset; offset < init_offset+ROW_LENGTH; offset++) {
-        if (player_grid & (BIT_ONE<<offset)) consecutive_counter++;
-        else consecutive_counter = 0;
-        if (consecutive_counter >= 4) return 1;
-    }
-
-    //printf("DEBUG : PASSED HORIZONTAL CHECK\n");
-    
-    // Diagonal up-right check
-    consecutive_counter = 0;
-    int8_t increment = ROW_LENGTH-1;
-    int8_t dist_to_closest_limit = (row_index < col) ? row_index : col;
-    col_t curr_col = col - dist_to_closest_limit;
-    init_offset = compute_offset(col, row_index) - increment * dist_to_closest_limit;
-    for (int8_t offset = init_offset; offset < ROW_LENGTH*COL_HEIGHT && curr_col < ROW_LENGTH; offset += increment) {
-        if (player_grid & (BIT_ONE<<offset)) consecutive_counter++;
-        else consecutive_counter = 0;
-        if (consecutive_counter >= 4) return 1;
-        curr_col++;
-    }
-
-    //printf("DEBUG : PASSED UPRIGHT CHECK\n");
-
-    // Diagonal up-left check
-    consecutive_counter = 0;
-    increment = ROW_LENGTH+1;
-    dist_to_closest_limit = (row_index < ROW_LENGTH-1-col) ? row_index : ROW_LENGTH-1-col;
-    curr_col = col + dist_to_closest_limit;
-    init_offset = compute_offset(col, row_index) - increment * dist_to_closest_limit;
-    for (int8_t offset = init_offset; offset < ROW_LENGTH*COL_HEIGHT && curr_col >= 0 ; offset += increment) {
-        if (player_grid & (BIT_ONE<<offset)) consecutive_counter++;
-        else consecutive_counter = 0;
-        if (consecutive_counter >= 4) return 1;
-        curr_col--;
-    }
-
-    //printf("DEBUG : PASSED UPLEFT CHECK\n");
-
-    return 0;
-}
-
-
 /*
 ===========================================
 =================== API ===================
@@ -123,6 +52,9 @@ game_t* game_init() {
     for (col_t col = 0; col < ROW_LENGTH; col++) g_ptr->cols_occupation[col] = 0;
     g_ptr->gridA = TURN_BIT;
     g_ptr->gridB = 0;
+    g_ptr->threats[PLAYER_A] = 0;
+    g_ptr->threats[PLAYER_B] = 0;
+    g_ptr->ply = 0;
     return g_ptr;
 }
 
@@ -136,7 +68,10 @@ game_t* copy(game_t* game) {
     if (new_game == NULL) return NULL;
     new_game->gridA = game->gridA;
     new_game->gridB = game->gridB;
+    new_game->threats[PLAYER_A] = game->threats[PLAYER_A];
+    new_game->threats[PLAYER_B] = game->threats[PLAYER_B];
     for (col_t c = 0; c < ROW_LENGTH; c++) new_game->cols_occupation[c] = game->cols_occupation[c];
+    new_game->ply = game->ply;
     return new_game;
 }
 
@@ -152,11 +87,7 @@ player_t winner(game_t* game) {
 
     if (game->gridA & WIN_BIT) return PLAYER_A;
     if (game->gridB & WIN_BIT) return PLAYER_B;
-    // The following 'if' statement translates to "if the top row is full"
-    grid_t gr = ((game->gridA | game->gridB) >> 35);    // DEBUG
-    gr = gr;    // DEBUG
-    if ((((game->gridA | game->gridB) >> ROW_LENGTH*(COL_HEIGHT-1)) & 0x7F) == 0x7F) 
-        return DRAW;
+    if (game->ply == NB_CELLS) return DRAW;
     return -1;
 }
 
@@ -173,22 +104,7 @@ int8_t play(game_t* game, player_t player, col_t col) {
     if (!is_their_turn_to_play(game, *this_grid)) return -1;
 
     // The move is valid
-    
-    // Add move
-    grid_t* other_grid = get_player_grid(game, 1-player);
-    int8_t offset = compute_offset(col, game->cols_occupation[col]);
-    *this_grid = *this_grid | (BIT_ONE << offset);
-    *this_grid = *this_grid & ~TURN_BIT;
-    *other_grid = *other_grid | TURN_BIT;
-    game->cols_occupation[col]++;
-
-    // Check for connect 4
-    if (makes_new_connect4(game, col, *this_grid)) {
-        *this_grid = *this_grid | WIN_BIT;
-        return 1;
-    } else if (winner(game) == DRAW) return 2;
-
-    return 0;
+    return play_unchecked(game, col);
 }
 
 
@@ -198,12 +114,40 @@ int8_t play_auto(game_t* game, col_t col) {
 }
 
 
+int8_t unplay(game_t* game, col_t col) {
+    // Preliminary checks
+    if (game == NULL) return ARG_ERROR;
+    if (col < 0 || col >= ROW_LENGTH) return ARG_ERROR;
+    if (game->cols_occupation[col] == 0) return -2;
+
+    player_t latest_player = 1-now_playing(game);    // the turn is passed even when the move wins
+    grid_t* this_grid = get_player_grid(game, latest_player);
+    int8_t row = game->cols_occupation[col] - 1;
+    int8_t offset = compute_offset(col, row);
+    if (!(*this_grid & (BIT_ONE << offset))) return -1;
+
+    // Remove move
+    grid_t* other_grid = get_player_grid(game, 1-latest_player);
+    *this_grid = (*this_grid & ~(BIT_ONE << offset) & ~WIN_BIT) | TURN_BIT;
+    *other_grid = *other_grid & ~TURN_BIT;
+    game->cols_occupation[col]--;
+    game->ply--;
+
+    // The latest player loses the threats made by the disk, and the freed cell may be a threat again for the other player.
+    // A cell on a line through the disk may still be completed by a row in another direction, so the threats of the latest
+    // player are computed again on the whole board
+    bitboard_t this_disks = pad_grid(*this_grid), other_disks = pad_grid(*other_grid);
+    game->threats[latest_player] = completing_cells(this_disks) & PADDED_BOARD & ~(this_disks | other_disks);
+    bitboard_t padded_bit = (bitboard_t) 1 << (row*PADDED_ROW + ROW_LENGTH-1-col);
+    game->threats[1-latest_player] |= completing_cells(other_disks) & padded_bit;
+    return 0;
+}
+
+
 int8_t play_auto_without_update(game_t* game, col_t col) {
-    game_t* cg = copy(game);
-    if (cg == NULL) return MEM_ERROR;
-    int8_t res = play_auto(cg, col);
-    game_destroy(cg);
-    return res;
+    if (game == NULL) return ARG_ERROR;
+    game_t cg = *game;
+    return play_auto(&cg, col);
 }
 
 
@@ -220,8 +164,26 @@ game_t* play_copy_auto(game_t* game, col_t col) {
 }
 
 
+bitboard_t completing_cells(bitboard_t disks) {
+    return completing_cells_along(disks, 1) | completing_cells_along(disks, PADDED_ROW)
+            | completing_cells_along(disks, PADDED_ROW+1) | completing_cells_along(disks, PADDED_ROW-1);
+}
+
+
+uint16_t winning_columns(game_t* game, player_t player) {
+    bitboard_t cells = game->threats[player];
+    uint16_t columns = 0;
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        int8_t row = game->cols_occupation[col];    // the row of the next disk played in the column
+        if (row < COL_HEIGHT && ((cells >> (row*PADDED_ROW + ROW_LENGTH-1-col)) & 1)) columns |= 1 << col;
+    }
+    return columns;
+}
+
+
 void print_game(game_t* game) {
-    printf("0 1 2 3 4 5 6\n");
+    for (col_t c = 0; c < ROW_LENGTH; c++) printf("%d ", c);
+    printf("\n");
     for(int8_t r = COL_HEIGHT-1; r >= 0; r--) {
         for (col_t c = 0; c < ROW_LENGTH; c++) {
             //char disk = '_';
@@ -259,7 +221,12 @@ void print_game(game_t* game) {
 
 void debug_print_game(game_t* game) {
     print_game(game);
+#ifdef WIDE_BITBOARDS
+    printf("%016lx%016lx\n%016lx%016lx\n", (uint64_t) ((bitboard_t) game->gridA >> 64), (uint64_t) game->gridA,
+            (uint64_t) ((bitboard_t) game->gridB >> 64), (uint64_t) game->gridB);
+#else
     printf("%ld\n%ld\n", game->gridA, game->gridB);
+#endif
     printf("[");
     for (col_t i = 0; i < ROW_LENGTH; i++) printf("%d, ", game->cols_occupation[i]);
     printf("]\n");
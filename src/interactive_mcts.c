@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "../headers/mcts.h"
+#include "../headers/network.h"
 
 
 /**
@@ -12,6 +13,7 @@ static void terminate_game(game_t* game, player_t w) {
     print_state();
     game_destroy(game);
     destroy_MCTS();
+    free_network();
     exit(0);
 }
 
@@ -60,14 +62,28 @@ static void ai_turn(game_t* game, col_t chosen_col) {
 
 int main(int argc, char* argv[]) {
 
-    if (argc < 2 || argc > 3) exit(-1);
+    if (argc < 2 || argc > 4) exit(-1);
     uint32_t max_visits = atoi(argv[1]);
-    player_t ai_plays_as = (argc == 3 && atoi(argv[2])) ? PLAYER_B : PLAYER_A;
+    player_t ai_plays_as = (argc >= 3 && atoi(argv[2])) ? PLAYER_B : PLAYER_A;
+    const char* tree_file = (argc == 4) ? argv[3] : NULL;
 
     game_t* game = game_init();
     if (game == NULL) exit(-1);
 
-    col_t ia_first_move = init_MCTS(ai_plays_as, max_visits);
+    // The search statistics are appended to the file named by the environment variable MCTS_STATS, if any
+    const char* stats_path = getenv("MCTS_STATS");
+    if (stats_path != NULL) set_MCTS_stats_output(fopen(stats_path, "a"));
+
+    set_MCTS_early_stop(1, 0);    // saves the end of the searches whose choice is already known
+
+    // The network whose weights file is named by the environment variable MCTS_NETWORK, if any, replaces the playouts
+    const char* network_path = getenv("MCTS_NETWORK");
+    if (network_path != NULL && load_network(network_path) == 0) {
+        set_MCTS_evaluator(network_evaluate, 16, 8);
+        set_MCTS_policy(network_policy, 1.5);
+    }
+
+    col_t ia_first_move = init_MCTS_from_file(ai_plays_as, max_visits, tree_file);
     if (ia_first_move == MEMERROR || ia_first_move == ARG_ERROR) {
         game_destroy(game);
         exit(-1);
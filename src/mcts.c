@@ -1,15 +1,67 @@
 #include "../headers/mcts.h"
+#include "../headers/playout.h"
+#include "../headers/thread_pool.h"
+#include "../headers/evaluation.h"
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 
 static player_t PLAYING_AS = PLAYER_B;
 static uint32_t MAX_VISITS = 20;    // one visit == one game simulation
+static double EXPLORATION = 0.9;    // exploration constant of the UCB formula
+static double PROGRESSIVE_BIAS = 0.0;    // weight of the static evaluation in the UCB formula. 0 : no bias
+static policy_function_t POLICY = NULL;    // the policy giving the priors of the PUCT formula. NULL : UCB1 is used instead
+static double C_PUCT = 1.5;    // weight of the priors in the PUCT formula
+static evaluator_function_t EVALUATOR = NULL;    // the evaluator replacing the playouts. NULL : the playouts are run
+static uint8_t VISITS_PER_EVALUATION = 16;    // visits an evaluation is worth
+static uint8_t LEAVES_PER_BATCH = 8;    // leaves whose children are evaluated together by a sequential search
+static uint8_t BATCH_PLAYOUTS = 0;    // playouts per new child, run as one batch at each expansion. 0 : one scalar playout per node
+static uint8_t SIMULATION_THREADS = 1;    // threads running the batch of playouts of an expansion, including the searching thread
+static uint8_t SEARCH_THREADS = 1;    // threads running MCTS iterations on the shared tree
+static boolean EARLY_STOP = 0;    // whether a search stops once its most visited move can't be overtaken
+static double EARLY_STOP_CONFIDENCE = 0.0;    // z-score of the confidence-based early stop. 0 : disabled
+static boolean PIN_THREADS = 1;    // whether the workers of the thread pool are pinned to their own CPU
 static node_t* tree_root = NULL;
+static children_stats_t root_stats;    // the statistics of the root of the tree, in lane 0, since it has no parent to hold them
+static uint32_t search_goal = 0;    // the visits of tree_root at which the current search stops
+
+static char* tree_file_path = NULL;    // the tree file written when the game leaves its depth. NULL if there is none
+static node_t* file_root = NULL;    // the root of the tree of the tree file : an ancestor of tree_root, or tree_root itself
+static uint8_t file_depth = 0;    // the depth of tree_root below file_root
 
 static uint32_t nb_recombined_visits = 0;    // for function print_state
 static col_t ai_choice = -1;    // for function print_state. -1 is only its init value
+static uint32_t root_visits[ROW_LENGTH];    // the visits of the children of the root at the end of the latest search
+
+
+/**
+ * Statistics of one run of the MCTS algorithm, emitted by MCTS() when stats_output is set.
+*/
+typedef struct search_stats {
+    uint32_t iterations;
+    boolean stopped_early;
+    uint64_t playouts;
+    uint64_t evaluations;
+    uint64_t nodes_allocated;
+    uint8_t max_depth;
+    uint32_t depth_histogram[ROW_LENGTH*COL_HEIGHT+1];    // number of iterations per depth of the selected leaf
+    uint64_t selection_ns;
+    uint64_t expansion_ns;    // excludes the simulations run during the expansion
+    uint64_t simulation_ns;
+    uint64_t backpropagation_ns;
+} search_stats_t;
+
+static FILE* stats_output = NULL;    // the stream on which the statistics are written. NULL if they are not requested
+static search_stats_t stats;
+static __thread uint64_t thread_simulation_ns = 0;    // the simulation time of the calling thread, to exclude it from its expansion time
 
 /*
 ===========================================
@@ -18,9 +70,200 @@ static col_t ai_choice = -1;    // for function print_state. -1 is only its init
 */
 
 
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Adds the duration of simulations (or evaluations) run by the calling thread to the statistics.
+*/
+static void record_simulation_time(uint64_t elapsed_ns) {
+    __atomic_fetch_add(&stats.simulation_ns, elapsed_ns, __ATOMIC_RELAXED);
+    thread_simulation_ns += elapsed_ns;
+}
+
+
+/**
+ * Adds the durations of the steps of an iteration (or of a batch of iterations) to the statistics. Can be called by
+ * several search threads at once : their times add up.
+ *
+ * @param t0 the time at which the selection started
+ * @param t1 the time at which the expansion started
+ * @param t2 the time at which the backpropagation started
+ * @param t3 the time at which the backpropagation ended
+ * @param simulation_ns the value of thread_simulation_ns at t1, to exclude the simulations from the expansion time
+*/
+static void record_step_times(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t simulation_ns) {
+    __atomic_fetch_add(&stats.selection_ns, t1 - t0, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.expansion_ns, (t2 - t1) - (thread_simulation_ns - simulation_ns), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats.backpropagation_ns, t3 - t2, __ATOMIC_RELAXED);
+}
+
+
+// ============= NODE ARENA ============
+
+
+/*
+The nodes are allocated from an arena and linked by their 32-bit indices in it. The arena grows by chunks of
+ARENA_CHUNK_NODES nodes, which never move once allocated, so that the search threads can keep using their nodes while
+another thread allocates a new chunk. Node 'id' is node id % ARENA_CHUNK_NODES of chunk id / ARENA_CHUNK_NODES.
+The freed nodes are reused first, through a list linked by their 'parent' field.
+*/
+#define ARENA_CHUNK_BITS 14
+#define ARENA_CHUNK_NODES ((node_index_t) 1 << ARENA_CHUNK_BITS)
+#define ARENA_MAX_CHUNKS ((uint32_t) 1 << (32-ARENA_CHUNK_BITS))
+
+static node_t* arena_chunks[ARENA_MAX_CHUNKS];
+static node_index_t arena_next = NO_NODE+1;    // the lowest index never allocated yet. Wraps to NO_NODE once all are used
+static node_index_t arena_free = NO_NODE;    // the latest freed node
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;    // the parallel search allocates nodes on several threads
+
+
+/**
+ * Returns the node at an index of the arena, or NULL for NO_NODE.
+*/
+static node_t* node_at(node_index_t id) {
+    if (id == NO_NODE) return NULL;
+    return &arena_chunks[id >> ARENA_CHUNK_BITS][id & (ARENA_CHUNK_NODES-1)];
+}
+
+
+/**
+ * Takes a node from the arena. Only its field 'id' is set.
+ * 
+ * @returns the node;
+ * NULL in case of memory allocation error or if all the indices are in use.
+*/
+static node_t* node_alloc() {
+    node_t* node = NULL;
+    pthread_mutex_lock(&arena_lock);
+    if (arena_free != NO_NODE) {
+        node = node_at(arena_free);
+        arena_free = node->parent;
+    } else if (arena_next != NO_NODE) {
+        node_t** chunk = &arena_chunks[arena_next >> ARENA_CHUNK_BITS];
+        if (*chunk == NULL) *chunk = (node_t*) malloc(ARENA_CHUNK_NODES * sizeof(node_t));
+        if (*chunk != NULL) {
+            node = &(*chunk)[arena_next & (ARENA_CHUNK_NODES-1)];
+            node->id = arena_next++;
+        }
+    }
+    pthread_mutex_unlock(&arena_lock);
+    return node;
+}
+
+
+/**
+ * Gives a node back to the arena. Its field 'id' is kept for when it is reused.
+*/
+static void node_free(node_t* node) {
+    pthread_mutex_lock(&arena_lock);
+    node->parent = arena_free;
+    arena_free = node->id;
+    pthread_mutex_unlock(&arena_lock);
+}
+
+
+/**
+ * Frees all the chunks of the arena. All the nodes must have been freed before.
+*/
+static void arena_reset() {
+    for (uint32_t c = 0; c < ARENA_MAX_CHUNKS && arena_chunks[c] != NULL; c++) {
+        free(arena_chunks[c]);
+        arena_chunks[c] = NULL;
+    }
+    arena_next = NO_NODE+1;
+    arena_free = NO_NODE;
+}
+
+
 // ============= NODES MANAGEMENT ============
 
 
+static node_t* child_of(node_t* node, col_t col) {
+    return node_at(node->children[col]);
+}
+
+
+static node_t* parent_of(node_t* node) {
+    return node_at(node->parent);
+}
+
+
+/**
+ * Sets a child of a node. A node getting a child outside of a parallel search is marked EXPANDED, so that the parallel
+ * searches only need to read its expansion to know whether its children are complete.
+*/
+static void set_child(node_t* node, col_t col, node_t* child) {
+    node->children[col] = (child == NULL) ? NO_NODE : child->id;
+    if (child != NULL && __atomic_load_n(&node->expansion, __ATOMIC_RELAXED) == NOT_EXPANDED)
+        __atomic_store_n(&node->expansion, EXPANDED, __ATOMIC_RELAXED);    // the search threads only try to claim it
+}
+
+
+static packed_stats_t pack_stats(uint32_t nb_wins, uint32_t nb_visits) {
+    return ((packed_stats_t) nb_wins << 32) | nb_visits;
+}
+
+
+static uint32_t packed_wins(packed_stats_t packed) {
+    return (uint32_t) (packed >> 32);
+}
+
+
+static uint32_t packed_visits(packed_stats_t packed) {
+    return (uint32_t) packed;
+}
+
+
+/**
+ * Returns a pointer to the packed statistics of a node, stored at lane node->index of the children_stats of its parent.
+*/
+static packed_stats_t* node_stats(node_t* node) {
+    children_stats_t* block = (node->parent == NO_NODE) ? &root_stats : &parent_of(node)->children_stats;
+    return &block->lanes[node->index];
+}
+
+
+/**
+ * Returns a consistent snapshot of the statistics of a node, even while other threads update them.
+*/
+static packed_stats_t load_stats(node_t* node) {
+    return __atomic_load_n(node_stats(node), __ATOMIC_RELAXED);
+}
+
+
+static void store_stats(node_t* node, uint32_t nb_wins, uint32_t nb_visits) {
+    __atomic_store_n(node_stats(node), pack_stats(nb_wins, nb_visits), __ATOMIC_RELAXED);
+}
+
+
+static uint32_t node_visits(node_t* node) {
+    return packed_visits(load_stats(node));
+}
+
+
+static uint32_t node_wins(node_t* node) {
+    return packed_wins(load_stats(node));
+}
+
+
+/**
+ * Adds simulation results to a node and all its ancestors, with one atomic addition per node.
+ * 
+ * @param node the deepest node to update
+ * @param incr_wins the number of wins to add
+ * @param incr_visits the number of visits to add
+*/
+static void backpropagate(node_t* node, uint32_t incr_wins, uint32_t incr_visits) {
+    packed_stats_t incr = pack_stats(incr_wins, incr_visits);
+    for (node_t* n = node; n != NULL; n = parent_of(n)) __atomic_fetch_add(node_stats(n), incr, __ATOMIC_RELAXED);
+}
+
+
 /**
  * Returns whether a MCTS node is a leaf
  * 
@@ -32,8 +275,8 @@ static boolean is_leaf(node_t* node) {
 
     boolean leaf = 1;
     for (col_t col = 0; col < ROW_LENGTH; col++)
-        if (node->children[col] != NULL) leaf = 0;
-    return (node->nb_visits <= (uint32_t) 1 || leaf);
+        if (node->children[col] != NO_NODE) leaf = 0;
+    return (node_visits(node) <= (uint32_t) 1 || leaf);
 }
 
 
@@ -46,7 +289,7 @@ static boolean is_leaf(node_t* node) {
  * @returns 1 if the simulation results in a win;
  * 0 if the simulation results in a loss or a draw;
  * -1 if the simulation results in an exception;
- * MEMERROR if the memory allocation is unsuccesful or if init_state is NULL
+ * MEMERROR if init_state is NULL
 */
 static int8_t MTCS_simulation(game_t* init_state) {
     if (init_state == NULL) return MEMERROR;
@@ -54,60 +297,80 @@ static int8_t MTCS_simulation(game_t* init_state) {
     if (winner_check >= 0) return (winner_check != DRAW) ? winner_check : 0;    // The second clause represents a draw in init_state
     else if (winner_check == ARG_ERROR) return -1;
 
-    game_t* playout = copy(init_state);
-    if (playout == NULL) {
-        return MEMERROR;
-    }
-
+    // The moves are valid by construction : the playout uses the unchecked play on a copy on the stack
+    game_t playout = *init_state;
     int8_t res = 0;
-    while (res != 1 && res != 2 && res != ARG_ERROR) {
-        col_t first_try_col = random() % ROW_LENGTH;
-        res = play_auto(playout, first_try_col);
-        for (col_t next = 1; next < ROW_LENGTH && res == -2; next++)
-                res = play_auto(playout, (first_try_col+next)%ROW_LENGTH);
-    }
-    if (res == ARG_ERROR) {
-        game_destroy(playout);
-        return -1;
+    while (res == 0) {
+        col_t col = random() % ROW_LENGTH;
+        while (playout.cols_occupation[col] >= COL_HEIGHT) col = (col+1) % ROW_LENGTH;
+        res = play_unchecked(&playout, col);
     }
     // res == 1 : victory achieved
-    player_t w = winner(playout);
-    game_destroy(playout);
+    return winner(&playout) == PLAYING_AS;
+}
+
 
-    if (w == PLAYING_AS) return 1;
-    else if (w == ARG_ERROR) return -1;
-    else return 0;
+/**
+ * Creates a MCTS node with no simulation data and no children.
+ * The node is not added to the children of its parent, but its statistics are reset in the parent's children_stats.
+ * 
+ * @param state is the state of a paused game.
+ * @param parent is the parent node. Is NULL for the root tree, and assumed non-null for all other nodes.
+ * @param index is the column of the move leading from 'parent' to the node. Is 0 for the root tree.
+ * 
+ * @returns The pointer to the newly created node in case of success;
+ * NULL in case of memory allocation error or if the argument 'state' is passed as NULL
+*/
+static node_t* create_node(game_t* state, node_t* parent, col_t index) {
+    if (state == NULL) return NULL;
+    node_t* new_node = node_alloc();
+    if (new_node == NULL) return NULL;
+    for (col_t col = 0; col < ROW_LENGTH; col++) new_node->children[col] = NO_NODE;
+    for (uint8_t lane = 0; lane < CHILDREN_LANES; lane++) {
+        new_node->children_stats.lanes[lane] = 0;
+        new_node->children_stats.bias[lane] = 0.0f;
+        new_node->children_stats.priors[lane] = 0.0f;
+    }
+    new_node->state = state;
+    new_node->parent = (parent == NULL) ? NO_NODE : parent->id;
+    new_node->index = index;
+    new_node->expansion = NOT_EXPANDED;
+    new_node->has_priors = 0;
+    // The priors of the children are given by the policy when the first child is created
+    if (parent != NULL && POLICY != NULL && !parent->has_priors) {
+        POLICY(parent->state, parent->children_stats.priors);
+        parent->has_priors = 1;
+    }
+    store_stats(new_node, 0, 0);
+    if (parent != NULL && PROGRESSIVE_BIAS > 0) parent->children_stats.bias[index] = evaluate(state, now_playing(parent->state));
+    __atomic_fetch_add(&stats.nodes_allocated, 1, __ATOMIC_RELAXED);
+    return new_node;
 }
 
 
 /**
- * Creates a MCTS node. 
+ * Creates a MCTS node and runs one simulation from it to initialise its values.
  * 
  * @param state is the state of a paused game. Is assumed non-null.
  * @param parent is the parent node. Is NULL for the root tree, and assumed non-null for all other nodes.
+ * @param index is the column of the move leading from 'parent' to the node. Is 0 for the root tree.
  * 
  * @returns The pointer to the newly created node in case of success;
  * NULL in case of memory allocation error or if the argument 'state' is passed as NULL
 */
-static node_t* create_node_and_simulate(game_t* state, node_t* parent) {
-    node_t* new_node = (node_t*) malloc(sizeof(node_t));
+static node_t* create_node_and_simulate(game_t* state, node_t* parent, col_t index) {
+    node_t* new_node = create_node(state, parent, index);
     if (new_node == NULL) return NULL;
-    for (col_t col = 0; col < ROW_LENGTH; col++) new_node->children[col] = NULL;
-    new_node->state = state;
-    new_node->parent = parent;
 
+    uint64_t start = (stats_output != NULL) ? now_ns() : 0;
     int8_t sim = MTCS_simulation(state);
+    if (stats_output != NULL) record_simulation_time(now_ns() - start);
+    stats.playouts++;
     if (sim == MEMERROR) {
-        free(new_node);
+        node_free(new_node);
         return NULL;
     }
-    else if (sim == -1) {
-        new_node->nb_visits = 0;
-        new_node->nb_wins = 0;
-    } else {
-        new_node->nb_visits = 1;
-        new_node->nb_wins = sim;
-    }
+    else if (sim != -1) store_stats(new_node, sim, 1);
     return new_node;
 }
 
@@ -119,69 +382,299 @@ static void recursive_node_destroy(node_t* node) {
     if (node == NULL) return;
     game_destroy(node->state);
     for (col_t c = 0; c < ROW_LENGTH; c++) 
-            recursive_node_destroy(node->children[c]);
-    free(node);
+            recursive_node_destroy(child_of(node, c));
+    node_free(node);
 
 }
 
 
-// ============= DETECTING THREATS ============
+// ============= TREE FILES ============
+
+
+/*
+A tree file starts with a header (TREE_FILE_MAGIC, TREE_FILE_VERSION, ROW_LENGTH, COL_HEIGHT and CONNECT_N (a byte
+each), the role played by the AI, and the gridA/gridB of the root state), followed by the nodes in pre-order. Each node is written as its nb_wins and nb_visits (uint32_t each)
+and a mask whose bit 'col' is set if the child at index 'col' follows in the file (a byte, or 2 bytes on the boards
+of more than 8 columns).
+The states are not written : they are recomputed from the root state when loading the tree.
+All values are written in the native byte order.
+*/
+static const char TREE_FILE_MAGIC[4] = {'C', '4', 'M', 'T'};
+static const uint8_t TREE_FILE_VERSION = 2;
+
+#if ROW_LENGTH <= 8
+typedef uint8_t children_mask_t;
+#else
+typedef uint16_t children_mask_t;
+#endif
 
 
 /**
- * Analyses whether the next player can make a Connect4 during their direct turn.
+ * Writes a node and, recursively, its children to a tree file.
  * 
- * @param game The game status.
+ * @param node the node to write. Is assumed non-null.
+ * @param file the file to write into. Is assumed to be opened in binary writing mode.
+ * @param depth_left the number of levels of children that may still be written below 'node'
  * 
- * @returns The column in [0, ROW_LENGTH[ which allows the next player to make a Connect4, if possible. In cases several columns
- * lead to a Connect4, returns the one the most on the left;
- * -1 if the player can not make a Connect4 in their direct next turn. In case of memory allocation errors,
- * false negatives may occur.
+ * @returns 0 on success;
+ * -1 if writing into the file fails
+*/
+static int8_t write_node(node_t* node, FILE* file, uint8_t depth_left) {
+    children_mask_t children_mask = 0;
+    if (depth_left > 0)
+        for (col_t col = 0; col < ROW_LENGTH; col++)
+            if (node->children[col] != NO_NODE) children_mask |= 1<<col;
+
+    uint32_t nb_wins = node_wins(node), nb_visits = node_visits(node);
+    if (fwrite(&nb_wins, sizeof(uint32_t), 1, file) != 1) return -1;
+    if (fwrite(&nb_visits, sizeof(uint32_t), 1, file) != 1) return -1;
+    if (fwrite(&children_mask, sizeof(children_mask_t), 1, file) != 1) return -1;
+
+    for (col_t col = 0; col < ROW_LENGTH; col++)
+        if ((children_mask & (1<<col)) && write_node(child_of(node, col), file, depth_left-1) != 0) return -1;
+    return 0;
+}
+
+
+/**
+ * Reads a node and, recursively, its children from a tree file.
+ * 
+ * @param state the state of the node to read. It is owned by the node if the reading succeeds, and freed otherwise.
+ * @param parent the parent of the node to read. Is NULL for the root node.
+ * @param index the column of the move leading from 'parent' to the node. Is 0 for the root node.
+ * @param file the file to read from. Is assumed to be opened in binary reading mode, just before the node.
  * 
+ * @returns the node read, with its children;
+ * NULL if the file is corrupted or in case of memory allocation error.
 */
-static col_t can_make_connect4_now(game_t* game) {
+static node_t* read_node(game_t* state, node_t* parent, col_t index, FILE* file) {
+    node_t* node = create_node(state, parent, index);
+    if (node == NULL) {
+        game_destroy(state);
+        return NULL;
+    }
+
+    children_mask_t children_mask;
+    uint32_t nb_wins, nb_visits;
+    if (fread(&nb_wins, sizeof(uint32_t), 1, file) != 1
+            || fread(&nb_visits, sizeof(uint32_t), 1, file) != 1
+            || fread(&children_mask, sizeof(children_mask_t), 1, file) != 1
+            || (children_mask >> ROW_LENGTH) != 0) {
+        recursive_node_destroy(node);
+        return NULL;
+    }
+    store_stats(node, nb_wins, nb_visits);
+
     for (col_t col = 0; col < ROW_LENGTH; col++) {
-        if (play_auto_without_update(game, col) == 1) return col;
+        if (!(children_mask & (1<<col))) continue;
+        game_t* child_state = play_copy_auto(state, col);    // NULL if the move is invalid : the file is corrupted
+        node_t* child = (child_state == NULL) ? NULL : read_node(child_state, node, col, file);
+        if (child == NULL) {
+            recursive_node_destroy(node);
+            return NULL;
+        }
+        set_child(node, col, child);
     }
-    return -1;
+    return node;
 }
 
 
 /**
- * Annalyses whether the latest player to have played threatens to make a Connect4 during their next turn.
+ * Reads a tree from a tree file.
  * 
- * @param game The game status.
+ * @param path the path to the tree file
+ * @param root_state the state expected at the root of the tree. It is owned by the tree if the reading succeeds,
+ * and freed otherwise.
  * 
- * @returns If the latest player threatens to make a Connect4 during their next turn, returns the column in [0, ROW_LENGTH[
- * which would allow them to do so. If there are multiple threats, returns the first one detected.
- * -1 if no threats are detected. In case of memory allocation errors,
- * false negatives may occur.
-*/
-static col_t does_latest_player_threaten_to_connect4(game_t* game) {
-    // To make sure the intermediary turn does not affect the possible Connect4, we make sure that the column of
-    // the intermadiary turn and the tested column do not collide. 
-    uint8_t nb_valid_iterations = 0;
-
-    for (col_t move1 = 0; move1 < ROW_LENGTH && nb_valid_iterations < 2; move1++) {
-        game_t* after_move1 = copy(game);
-        if (after_move1 == NULL) continue;
-        if (play_auto(after_move1, move1) != 0) {
-            game_destroy(after_move1);
-            continue; 
+ * @returns the root of the tree read;
+ * NULL if the file can not be read, is corrupted, was written for another board, for the other role or for another
+ * root state.
+*/
+static node_t* read_tree(const char* path, game_t* root_state) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        game_destroy(root_state);
+        return NULL;
+    }
+
+    char magic[4];
+    uint8_t version;
+    uint8_t dimensions[3];
+    player_t playing_as;
+    grid_t gridA, gridB;
+    boolean valid_header = fread(magic, sizeof(char), 4, file) == 4
+            && fread(&version, sizeof(uint8_t), 1, file) == 1
+            && fread(dimensions, sizeof(uint8_t), 3, file) == 3
+            && fread(&playing_as, sizeof(player_t), 1, file) == 1
+            && fread(&gridA, sizeof(grid_t), 1, file) == 1
+            && fread(&gridB, sizeof(grid_t), 1, file) == 1;
+    if (!valid_header
+            || magic[0] != TREE_FILE_MAGIC[0] || magic[1] != TREE_FILE_MAGIC[1]
+            || magic[2] != TREE_FILE_MAGIC[2] || magic[3] != TREE_FILE_MAGIC[3]
+            || version != TREE_FILE_VERSION
+            || dimensions[0] != ROW_LENGTH || dimensions[1] != COL_HEIGHT || dimensions[2] != CONNECT_N
+            || playing_as != PLAYING_AS
+            || gridA != root_state->gridA || gridB != root_state->gridB) {
+        game_destroy(root_state);
+        fclose(file);
+        return NULL;
+    }
+
+    node_t* root = read_node(root_state, NULL, 0, file);
+    fclose(file);
+    return root;
+}
+
+
+/**
+ * Writes a tree to a tree file.
+ * 
+ * @param path the path to the tree file. It is overwritten if it already exists.
+ * @param root the root of the tree. Is assumed non-null.
+ * @param max_depth the number of levels of nodes below the root to write
+ * 
+ * @returns 0 if the tree was written;
+ * -1 if the file could not be written
+*/
+static int8_t write_tree(const char* path, node_t* root, uint8_t max_depth) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return -1;
+
+    const uint8_t dimensions[3] = {ROW_LENGTH, COL_HEIGHT, CONNECT_N};
+    boolean success = fwrite(TREE_FILE_MAGIC, sizeof(char), 4, file) == 4
+            && fwrite(&TREE_FILE_VERSION, sizeof(uint8_t), 1, file) == 1
+            && fwrite(dimensions, sizeof(uint8_t), 3, file) == 3
+            && fwrite(&PLAYING_AS, sizeof(player_t), 1, file) == 1
+            && fwrite(&root->state->gridA, sizeof(grid_t), 1, file) == 1
+            && fwrite(&root->state->gridB, sizeof(grid_t), 1, file) == 1
+            && write_node(root, file, max_depth) == 0;
+    if (fclose(file) != 0 || !success) {
+        remove(path);    // never leave a truncated tree file behind
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Destroys the descendants of a node which are deeper than a tree file keeps.
+ * 
+ * @param node the node. Is assumed non-null.
+ * @param depth_left the number of levels of children kept below 'node'
+*/
+static void trim_node(node_t* node, uint8_t depth_left) {
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        node_t* child = child_of(node, col);
+        if (child == NULL) continue;
+        if (depth_left > 0) trim_node(child, depth_left-1);
+        else {
+            recursive_node_destroy(child);
+            node->children[col] = NO_NODE;
         }
-        // valid iteration
-        nb_valid_iterations++;
-        for (col_t move2 = 0; move2 < ROW_LENGTH; move2++) {
-            if (move1 == move2) continue;    // first move and second move's columns collide
-            if (play_auto_without_update(after_move1, move2) == 1) {
-                game_destroy(after_move1);
-                return move2;    // move2 threatens a Connect4 from the latest player
-            }
+    }
+}
+
+
+/**
+ * Writes the tree of the tree file, then detaches tree_root from it and destroys the rest of it.
+ * The search goes on from tree_root as without a tree file.
+*/
+static void leave_file_tree() {
+    write_tree(tree_file_path, file_root, TREE_FILE_MAX_DEPTH);    // the tree file is only a cache : a failure is ignored
+    if (tree_root != file_root) {
+        if (tree_root != NULL) {
+            root_stats.lanes[0] = load_stats(tree_root);
+            parent_of(tree_root)->children[tree_root->index] = NO_NODE;
+            tree_root->parent = NO_NODE;
+            tree_root->index = 0;
         }
-        game_destroy(after_move1);
+        recursive_node_destroy(file_root);
+    }
+    free(tree_file_path);
+    tree_file_path = NULL;
+    file_root = NULL;
+    file_depth = 0;
+}
+
+
+// ============= DETECTING THREATS ============
+
+
+/**
+ * Analyses whether the next player can make a Connect4 during their direct turn.
+ * 
+ * @param game The game status.
+ * 
+ * @returns The mask of the columns which allow the next player to make a Connect4 : bit 'col' is set for the column 'col';
+ * 0 if the player can not make a Connect4 in their direct next turn.
+*/
+static uint16_t can_make_connect4_now(game_t* game) {
+    return winning_columns(game, now_playing(game));
+}
+
+
+/**
+ * Annalyses whether the latest player to have played threatens to make a Connect4 during their next turn.
+ * 
+ * @param game The game status.
+ * 
+ * @returns The mask of the columns which would allow the latest player to make a Connect4 during their next turn, unless
+ * the next player plays there first : bit 'col' is set for the column 'col';
+ * 0 if no threats are detected.
+*/
+static uint16_t does_latest_player_threaten_to_connect4(game_t* game) {
+    return winning_columns(game, 1-now_playing(game));
+}
+
+
+// ============= PARALLEL SIMULATIONS ============
+
+
+/**
+ * A slice of the batch of playouts of an expansion, run by one task of the thread pool.
+*/
+typedef struct simulation_job {
+    game_t* const* states;
+    uint32_t nb_states;
+    uint64_t seed;    // each slice has its own seed, so the threads never share a random state
+    uint8_t* results;
+} simulation_job_t;
+
+
+static void run_simulation_job(void* arg) {
+    simulation_job_t* job = (simulation_job_t*) arg;
+    if (job->nb_states > 0) run_playouts(job->states, job->nb_states, PLAYING_AS, job->seed, job->results);
+}
+
+
+/**
+ * Runs a batch of playouts in SIMULATION_THREADS slices : the searching thread runs the first one, the thread pool
+ * the others, and all of them are finished when returning.
+ * The slices are multiples of PLAYOUT_LANES, so that no thread runs a partly empty vector of boards before the last one.
+ * 
+ * @param states the initial states of the playouts
+ * @param nb_states the number of playouts
+ * @param results filled with the result of each playout, as in run_playouts
+*/
+static void run_parallel_playouts(game_t* const* states, uint32_t nb_states, uint8_t* results) {
+    simulation_job_t jobs[MAX_SIMULATION_THREADS];
+    uint32_t nb_vectors = (nb_states + PLAYOUT_LANES-1) / PLAYOUT_LANES;
+    uint32_t first = 0;
+    for (uint8_t t = 0; t < SIMULATION_THREADS; t++) {
+        uint32_t last = PLAYOUT_LANES * (nb_vectors * (t+1) / SIMULATION_THREADS);
+        if (last > nb_states) last = nb_states;
+        jobs[t].states = states + first;
+        jobs[t].nb_states = last - first;
+        jobs[t].seed = ((uint64_t) random() << 32) ^ (uint64_t) random();
+        jobs[t].results = results + first;
+        first = last;
     }
 
-    return -1;
+    task_group_t group = {0};
+    for (uint8_t t = 1; t < SIMULATION_THREADS; t++)
+        if (jobs[t].nb_states > 0) pool_submit(&group, run_simulation_job, &jobs[t]);
+    run_simulation_job(&jobs[0]);
+    pool_wait(&group);
 }
 
 
@@ -189,28 +682,112 @@ static col_t does_latest_player_threaten_to_connect4(game_t* game) {
 
 
 /**
- * Compute the UCB weight of a non-leaf node according to Kocsis and Szepesvári (UCB).
+ * Computes the UCB weights of all the children of a non-leaf node according to Kocsis and Szepesvári (UCB),
+ * or with the PUCT formula if a policy is set, in one pass over the lanes of its children_stats.
+ * With the progressive bias, PROGRESSIVE_BIAS * bias / (n + 1) is added.
+ * 
+ * @param node the MCTS node whose children's weights we want to compute. Must not be leaf.
+ * @param ucb filled with the weight of each child. A relatively high value makes it very likely to be selected;
+ * 0.0 for a child without visits (leaf with error during first simulation) with UCB1, or if 'node' has no visits;
+ * -1.0 for the lanes without a child.
+*/
+static void compute_children_UCB(node_t* node, float ucb[CHILDREN_LANES]) {
+    children_stats_t* block = &node->children_stats;
+    float N = (float) node_visits(node);
+    // the currently player will always try to maximise THEIR win ratio, not the AI's
+    // If the AI plays in 'node', its children should have a great score if they maximise the w/n ratio.
+    boolean ai_chooses = (now_playing(node->state) == PLAYING_AS);
+
+    if (N == 0) {    // empty MTCS tree
+        for (uint8_t lane = 0; lane < CHILDREN_LANES; lane++) ucb[lane] = 0.0f;
+    } else {
+        float log_term = 2*logf(N);
+        float prior_term = (float) C_PUCT * sqrtf(N);
+        const float uniform_priors[CHILDREN_LANES] = {[0 ... CHILDREN_LANES-1] = 1.0f / ROW_LENGTH};
+        const float* priors = node->has_priors ? block->priors : uniform_priors;
+#ifdef __AVX__
+        __m256 zero = _mm256_setzero_ps();
+        // A vector load doesn't load each lane atomically : the lanes are first copied one atomic load at a time
+        packed_stats_t lanes[CHILDREN_LANES];
+        for (uint8_t lane = 0; lane < CHILDREN_LANES; lane++) lanes[lane] = __atomic_load_n(&block->lanes[lane], __ATOMIC_RELAXED);
+        for (uint8_t first = 0; first < CHILDREN_LANES; first += 8) {    // 8 lanes per vector register
+            // Each 64-bit lane is loaded as (visits, wins) pairs of 32-bit words, then the pairs are deinterleaved
+            __m256 low = _mm256_loadu_ps((const float*) &lanes[first]);
+            __m256 high = _mm256_loadu_ps((const float*) &lanes[first+4]);
+            __m256 a = _mm256_permute2f128_ps(low, high, 0x20);    // lanes 0, 1, 4, 5 of the 8 lanes
+            __m256 b = _mm256_permute2f128_ps(low, high, 0x31);    // lanes 2, 3, 6, 7 of the 8 lanes
+            __m256 n = _mm256_cvtepi32_ps(_mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))));
+            __m256 w = _mm256_cvtepi32_ps(_mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+            __m256 n_is_zero = _mm256_cmp_ps(n, zero, _CMP_EQ_OQ);
+            __m256 ratio = _mm256_div_ps(w, n);
+            if (!ai_chooses) ratio = _mm256_sub_ps(_mm256_set1_ps(1.0f), ratio);
+            __m256 weights;
+            if (POLICY != NULL) {
+                __m256 exploration = _mm256_div_ps(_mm256_mul_ps(_mm256_set1_ps(prior_term), _mm256_loadu_ps(priors + first)),
+                        _mm256_add_ps(n, _mm256_set1_ps(1.0f)));
+                weights = _mm256_add_ps(_mm256_blendv_ps(ratio, zero, n_is_zero), exploration);    // a child without visits has Q = 0
+            } else {
+                __m256 exploration = _mm256_mul_ps(_mm256_set1_ps((float) EXPLORATION),
+                        _mm256_sqrt_ps(_mm256_div_ps(_mm256_set1_ps(log_term), n)));
+                weights = _mm256_blendv_ps(_mm256_add_ps(ratio, exploration), zero, n_is_zero);
+            }
+            if (PROGRESSIVE_BIAS > 0) {
+                __m256 bias = _mm256_div_ps(_mm256_mul_ps(_mm256_set1_ps((float) PROGRESSIVE_BIAS), _mm256_loadu_ps(block->bias + first)),
+                        _mm256_add_ps(n, _mm256_set1_ps(1.0f)));
+                weights = _mm256_add_ps(weights, _mm256_blendv_ps(bias, zero, n_is_zero));
+            }
+            _mm256_storeu_ps(ucb + first, weights);
+        }
+#else
+        for (uint8_t lane = 0; lane < CHILDREN_LANES; lane++) {
+            packed_stats_t packed = __atomic_load_n(&block->lanes[lane], __ATOMIC_RELAXED);
+            float n = (float) packed_visits(packed);
+            float w = (float) packed_wins(packed);
+            float ratio = (n != 0) ? (ai_chooses ? w/n : 1-w/n) : 0.0f;
+            float bias = (n != 0) ? (float) PROGRESSIVE_BIAS * block->bias[lane] / (n+1) : 0.0f;
+            if (POLICY != NULL) ucb[lane] = ratio + prior_term * priors[lane] / (n+1) + bias;
+            else ucb[lane] = (n != 0) ? ratio + (float) EXPLORATION * sqrtf(log_term/n) + bias : 0.0f;
+        }
+#endif
+    }
+
+    for (col_t col = 0; col < ROW_LENGTH; col++)
+        if (node->children[col] == NO_NODE) ucb[col] = -1.0f;
+}
+
+
+/**
+ * Selects the child of a node with the highest UCB score, picked at random amongst the ties.
  * 
- * @param node the MCTS node whose weight we want to compute. Must not be leaf.
+ * @param node the parent node
  * 
- * @return the weight of that node computed via UCB. A relatively high value makes it very likely to be selected;
- * 0.0 if 'node' is NULL.
+ * @returns the selected child;
+ * NULL if the node has no children.
 */
-static double compute_UCB(node_t* node) {
-    // Preliminary check
-    if (node == NULL) return 0.0;
+static node_t* select_child(node_t* node) {
+    float ucb[CHILDREN_LANES];
+    compute_children_UCB(node, ucb);
 
-    double N = (double) node->parent->nb_visits;
-    double n = (double) node->nb_visits;
-    double w = (double) node->nb_wins;
-    if (n != 0 && N != 0) {    // usual case
-        // the currently player will always try to maximise THEIR win ratio, not the AI's
-        // If now_playing != PLAYING_AS, that means the parent of node represents the turn of the AI.
-        // Therefore, 'node' should have a great score if it maximises the w/n ratio.
-        double ratio = (now_playing(node->state) != PLAYING_AS) ? w/n : 1-w/n;
-        return ratio + 0.9 * sqrt(2*log(N)/n);
+    uint8_t nb_ties = 1;
+    float max_UCB = -0.1f;
+    node_t* max_node = NULL;
+    for (uint8_t i = 0; i < ROW_LENGTH; i++) {
+        if (ucb[i] > max_UCB) {
+            max_UCB = ucb[i];
+            max_node = child_of(node, i);
+            nb_ties = 1;
+        } else if (ucb[i] == max_UCB) nb_ties++;
+    }
+    if (nb_ties == 1) return max_node;
+
+    // else there are [nb_ties] nodes with the same UCB -> pick one at random
+    col_t selected = (uint8_t) (random() % nb_ties);
+    for (col_t i = 0; i < ROW_LENGTH; i++) {
+        if (ucb[i] == max_UCB) selected--;
+        if (selected < 0) return child_of(node, i);
     }
-    else return 0.0;    // empty MTCS tree or leaf with error during first simulation (during the node creation)
+
+    return max_node; // should never get there. we choose the last children with the highest UCB
 }
 
 
@@ -224,32 +801,125 @@ static double compute_UCB(node_t* node) {
 static node_t* MCTS_selection(node_t* node) {
     // Preliminary check
     if (is_leaf(node)) return node;
+    return MCTS_selection(select_child(node));
+}
 
-    uint8_t nb_ties = 1;
-    double max_UCB = -0.1;
-    node_t* max_node = NULL;
-    for (uint8_t i = 0; i < ROW_LENGTH; i++) {
-        node_t* n = node->children[i];
-        if (n != NULL) {
-            double UCB = compute_UCB(n);
-            if (UCB > max_UCB) {
-                max_UCB = UCB;
-                max_node = n;
-                nb_ties = 1;
-            } else if (UCB == max_UCB) nb_ties++;
-        }
+
+/**
+ * Returns the number of playouts run for each new child at an expansion. 0 means one scalar playout per child.
+*/
+static uint8_t playouts_per_child() {
+    if (BATCH_PLAYOUTS == 0 && (SIMULATION_THREADS > 1 || SEARCH_THREADS > 1)) return 1;    // the threads run batches
+    return BATCH_PLAYOUTS;
+}
+
+
+/**
+ * Returns the number of visits simulated (or evaluated) by one expansion, which is also the weight of a finished game in the backpropagation.
+*/
+static uint32_t visits_per_expansion() {
+    if (EVALUATOR != NULL) return ROW_LENGTH * VISITS_PER_EVALUATION;
+    return ROW_LENGTH * ((playouts_per_child() > 0) ? playouts_per_child() : 1);
+}
+
+
+/**
+ * Returns the largest number of visits one loop of a search thread adds to the root : one expansion, or one per leaf of
+ * a batch for the batched search.
+*/
+static uint32_t visits_per_loop() {
+    boolean batched = (SEARCH_THREADS == 1 && EVALUATOR != NULL && LEAVES_PER_BATCH > 1);
+    return visits_per_expansion() * (batched ? LEAVES_PER_BATCH : 1);
+}
+
+
+/**
+ * Same as MCTS_expansion_simulation, but the children are created first and playouts_per_child() playouts are then run
+ * for each of them, all in one batch, split between SIMULATION_THREADS threads.
+ * 
+ * @param selected_leaf the MCTS node selected during the selection step of the MCTS algorithm. Is assumed to be non-null.
+*/
+static void batch_expansion_simulation(node_t* selected_leaf) {
+    game_t* states[ROW_LENGTH*UINT8_MAX];
+    uint8_t results[ROW_LENGTH*UINT8_MAX];
+    uint32_t nb_states = 0;
+    uint8_t nb_playouts = playouts_per_child();
+
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        node_t* child = create_node(play_copy_auto(selected_leaf->state, col), selected_leaf, col);
+        set_child(selected_leaf, col, child);
+        if (child == NULL) continue;
+        for (uint8_t i = 0; i < nb_playouts; i++) states[nb_states++] = child->state;
     }
-    if (nb_ties == 1) return MCTS_selection(max_node);
 
-    // else there are [nb_ties] nodes with the same UCB -> pick one at random
-    col_t selected = (uint8_t) (random() % nb_ties);
-    for (col_t i = 0; i < ROW_LENGTH; i++) {
-        node_t* n = node->children[i];
-        if (compute_UCB(n) == max_UCB) selected--;
-        if (selected < 0) return MCTS_selection(n);
+    uint64_t start = (stats_output != NULL) ? now_ns() : 0;
+    if (SIMULATION_THREADS > 1 && SEARCH_THREADS == 1) run_parallel_playouts(states, nb_states, results);
+    else {
+        uint64_t seed = ((uint64_t) random() << 32) ^ (uint64_t) random();
+        run_playouts(states, nb_states, PLAYING_AS, seed, results);
+    }
+    if (stats_output != NULL) record_simulation_time(now_ns() - start);
+    __atomic_fetch_add(&stats.playouts, nb_states, __ATOMIC_RELAXED);
+
+    uint32_t first = 0;
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        uint32_t nb_wins = 0, nb_visits = 0;
+        if (selected_leaf->children[col] != NO_NODE) {
+            for (uint8_t i = 0; i < nb_playouts; i++) nb_wins += results[first+i];
+            nb_visits = nb_playouts;
+            first += nb_playouts;
+        }
+        __atomic_store_n(&selected_leaf->children_stats.lanes[col], pack_stats(nb_wins, nb_visits), __ATOMIC_RELAXED);
     }
+}
 
-    return MCTS_selection(max_node); // should never get there. we choose the last children with the highest UCB
+
+/**
+ * Same as MCTS_expansion_simulation for several leaves, but the children are evaluated by EVALUATOR instead of playouts,
+ * all in one call. The finished children get the exact result, and the others also get the priors of their own children.
+ * 
+ * @param leaves the leaves to expand. Are assumed non-null, different and not finished.
+ * @param nb_leaves the number of leaves, at most MAX_LEAVES_PER_BATCH
+*/
+static void evaluated_expansion(node_t* const* leaves, uint8_t nb_leaves) {
+    game_t* states[MAX_LEAVES_PER_BATCH*ROW_LENGTH];
+    node_t* evaluated[MAX_LEAVES_PER_BATCH*ROW_LENGTH];
+    float values[MAX_LEAVES_PER_BATCH*ROW_LENGTH];
+    float priors[MAX_LEAVES_PER_BATCH*ROW_LENGTH][ROW_LENGTH];
+    uint32_t nb_states = 0;
+
+    for (uint8_t l = 0; l < nb_leaves; l++) {
+        for (col_t col = 0; col < ROW_LENGTH; col++) {
+            node_t* child = create_node(play_copy_auto(leaves[l]->state, col), leaves[l], col);
+            set_child(leaves[l], col, child);
+            if (child == NULL) continue;
+            player_t w = winner(child->state);
+            uint32_t nb_wins = (w == PLAYING_AS) ? VISITS_PER_EVALUATION : 0;
+            if (w < 0) {
+                states[nb_states] = child->state;
+                evaluated[nb_states++] = child;
+            }
+            __atomic_store_n(&leaves[l]->children_stats.lanes[col], pack_stats(nb_wins, VISITS_PER_EVALUATION), __ATOMIC_RELAXED);
+        }
+    }
+    if (nb_states == 0) return;
+
+    uint64_t start = (stats_output != NULL) ? now_ns() : 0;
+    boolean failed = (EVALUATOR(states, nb_states, values, priors) != 0);
+    if (stats_output != NULL) record_simulation_time(now_ns() - start);
+    __atomic_fetch_add(&stats.evaluations, nb_states, __ATOMIC_RELAXED);
+
+    for (uint32_t i = 0; i < nb_states; i++) {
+        node_t* child = evaluated[i];
+        float value = failed ? 0.5f : values[i];    // for the player to move in the child
+        if (now_playing(child->state) != PLAYING_AS) value = 1.0f - value;
+        uint32_t nb_wins = (uint32_t) lroundf(value * VISITS_PER_EVALUATION);
+        __atomic_store_n(&parent_of(child)->children_stats.lanes[child->index],
+                pack_stats(nb_wins, VISITS_PER_EVALUATION), __ATOMIC_RELAXED);
+        if (failed) continue;
+        for (col_t col = 0; col < ROW_LENGTH; col++) child->children_stats.priors[col] = priors[i][col];
+        child->has_priors = 1;
+    }
 }
 
 
@@ -260,44 +930,279 @@ static node_t* MCTS_selection(node_t* node) {
  * @param selected_leaf the MCTS node selected during the selection step of the MCTS algorithm. Is assumed to be non-null.
 */
 static void MCTS_expansion_simulation(node_t* selected_leaf) {
+    if (EVALUATOR != NULL && winner(selected_leaf->state) < 0) {
+        evaluated_expansion(&selected_leaf, 1);
+        return;
+    }
+    if (playouts_per_child() > 0) {
+        batch_expansion_simulation(selected_leaf);
+        return;
+    }
     for (col_t col = 0; col < ROW_LENGTH; col++) {
         game_t* new_state = play_copy_auto(selected_leaf->state, col);
-        if (new_state == NULL) selected_leaf->children[col] = NULL;
-        else selected_leaf->children[col] = create_node_and_simulate(new_state, selected_leaf);
+        set_child(selected_leaf, col, (new_state == NULL) ? NULL : create_node_and_simulate(new_state, selected_leaf, col));
     }
 }
 
 
 /**
- * Applies the backpropagation step of the MCTS algorithm to the specified node.
+ * Computes the results to backpropagate from a node that was just expanded.
  * 
  * @param selected_old_leaf is the node that was selected in the selection step of the MCTS. All its children are leaves.
+ * @param incr_wins set to the number of wins to backpropagate
+ * @param incr_visits set to the number of visits to backpropagate
 */
-static void MTCS_backpropagation(node_t* selected_old_leaf) {
-    uint32_t incr_wins = 0;
-    uint32_t incr_visits = 0;
+static void expansion_results(node_t* selected_old_leaf, uint32_t* incr_wins, uint32_t* incr_visits) {
+    *incr_wins = 0;
+    *incr_visits = 0;
 
+    // A finished game counts as many visits as an expansion would have simulated
+    uint32_t terminal_visits = visits_per_expansion();
     player_t w = winner(selected_old_leaf->state);
     if (w == PLAYING_AS) {    // case selected node is a win for the ai
-        incr_wins= 7;
-        incr_visits = 7;
+        *incr_wins = terminal_visits;
+        *incr_visits = terminal_visits;
     } else if (w == 1-PLAYING_AS) {    // case selected node is a win for the human
-        incr_visits = 7;
+        *incr_visits = terminal_visits;
     } else {
-        // Computing the total increments to backpropagate
-        for (col_t col = 0; col < ROW_LENGTH; col++) {
-            if (selected_old_leaf->children[col] != NULL) {
-                incr_visits += selected_old_leaf->children[col]->nb_visits;
-                incr_wins += selected_old_leaf->children[col]->nb_wins;    // supposedly 0 or 1 if only 1 simulation when creating node
-            }
+        // Computing the total increments to backpropagate (the lanes without a child are empty)
+        for (uint8_t lane = 0; lane < CHILDREN_LANES; lane++) {
+            packed_stats_t packed = __atomic_load_n(&selected_old_leaf->children_stats.lanes[lane], __ATOMIC_RELAXED);
+            *incr_visits += packed_visits(packed);
+            *incr_wins += packed_wins(packed);    // supposedly 0 or 1 if only 1 simulation when creating node
         }
     }
+}
+
+
+/**
+ * Applies the backpropagation step of the MCTS algorithm to the specified node.
+ * 
+ * @param selected_old_leaf is the node that was selected in the selection step of the MCTS. All its children are leaves.
+*/
+static void MTCS_backpropagation(node_t* selected_old_leaf) {
+    uint32_t incr_wins, incr_visits;
+    expansion_results(selected_old_leaf, &incr_wins, &incr_visits);
 
     // Backpropagating the increments to the ancestor nodes
-    for (node_t* n = selected_old_leaf; n != NULL; n = n->parent) {
-        n->nb_visits += incr_visits;
-        n->nb_wins += incr_wins;
+    backpropagate(selected_old_leaf, incr_wins, incr_visits);
+}
+
+
+// ============= EARLY STOP ============
+
+
+/**
+ * Returns whether the current search can stop before MAX_VISITS, according to the enabled early stop rules :
+ * - the most visited child of the root leads the second one by more visits than the search can still add, so the choice
+ *   made at the end of the search is already known ;
+ * - its win ratio exceeds the win ratio of every other child by more than EARLY_STOP_CONFIDENCE standard deviations, with
+ *   the variance of each ratio bounded by 1/(4n). The choice is then very unlikely to change if the search goes on.
+ * The visits added by the iterations still running on the other search threads are counted as if they were not added yet.
+*/
+static boolean can_stop_early() {
+    if (!EARLY_STOP && EARLY_STOP_CONFIDENCE <= 0) return 0;
+    packed_stats_t packed[ROW_LENGTH];
+    uint32_t best_visits = 0, second_visits = 0;
+    col_t best_col = -1;
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        packed[col] = (tree_root->children[col] != NO_NODE) ? load_stats(child_of(tree_root, col)) : 0;
+        uint32_t visits = packed_visits(packed[col]);
+        if (visits > best_visits) {
+            second_visits = best_visits;
+            best_visits = visits;
+            best_col = col;
+        } else if (visits > second_visits) second_visits = visits;
+    }
+    if (best_col < 0) return 0;
+
+    // A new loop starts as long as the root has less than search_goal visits, and can overshoot it by one loop
+    uint32_t root_visits = node_visits(tree_root);
+    uint32_t remaining = (root_visits < search_goal) ? search_goal - root_visits - 1 + visits_per_loop() : 0;
+    uint32_t in_flight = (SEARCH_THREADS-1) * visits_per_expansion();
+    if (EARLY_STOP && best_visits - second_visits > remaining + in_flight) return 1;
+    if (EARLY_STOP_CONFIDENCE <= 0) return 0;
+
+    boolean ai_chooses = (now_playing(tree_root->state) == PLAYING_AS);
+    float best_ratio = (float) packed_wins(packed[best_col]) / best_visits;
+    if (!ai_chooses) best_ratio = 1 - best_ratio;
+    float best_bound = best_ratio - (float) EARLY_STOP_CONFIDENCE * 0.5f / sqrtf(best_visits);
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        if (col == best_col || tree_root->children[col] == NO_NODE) continue;
+        uint32_t visits = packed_visits(packed[col]);
+        if (visits == 0) return 0;
+        float ratio = (float) packed_wins(packed[col]) / visits;
+        if (!ai_chooses) ratio = 1 - ratio;
+        if (ratio + (float) EARLY_STOP_CONFIDENCE * 0.5f / sqrtf(visits) >= best_bound) return 0;
+    }
+    return 1;
+}
+
+
+// ============= TREE PARALLELISATION ============
+
+
+/**
+ * Adds (or removes) a virtual loss to a node, on behalf of a search thread going through it : as many visits as an expansion
+ * simulates, all lost by the player choosing the node, so that the other threads prefer other paths until its results are
+ * backpropagated. The wins are counted for PLAYING_AS, so a loss of its opponent is counted as wins.
+ * 
+ * @param node the node, which is not the root
+ * @param revert 0 to add the virtual loss, 1 to remove it
+*/
+static void virtual_loss(node_t* node, boolean revert) {
+    uint32_t loss = visits_per_expansion();
+    boolean ai_chooses = (now_playing(parent_of(node)->state) == PLAYING_AS);
+    packed_stats_t packed = pack_stats(ai_chooses ? 0 : loss, loss);
+    if (revert) __atomic_fetch_sub(node_stats(node), packed, __ATOMIC_RELAXED);
+    else __atomic_fetch_add(node_stats(node), packed, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Returns whether the children of a node can be read by a search thread. The children of a node being expanded by another
+ * thread are never scanned : they and their statistics are only complete once the node is EXPANDED.
+*/
+static boolean is_expanded(node_t* node) {
+    return __atomic_load_n(&node->expansion, __ATOMIC_ACQUIRE) == EXPANDED;
+}
+
+
+/**
+ * Same as MCTS_selection, but adds a virtual loss to each node of the selected path below the root.
+*/
+static node_t* parallel_selection(node_t* node) {
+    while (is_expanded(node)) {
+        node_t* child = select_child(node);
+        if (child == NULL) break;
+        virtual_loss(child, 0);
+        node = child;
+    }
+    return node;
+}
+
+
+/**
+ * Counts the depth of a selected leaf in the statistics. Can be called by several search threads at once.
+ *
+ * @param leaf the leaf selected by an iteration
+*/
+static void record_depth(node_t* leaf) {
+    uint8_t depth = 0;
+    for (node_t* n = leaf; n != tree_root; n = parent_of(n)) depth++;
+    __atomic_fetch_add(&stats.depth_histogram[depth], 1, __ATOMIC_RELAXED);
+    uint8_t max_depth = __atomic_load_n(&stats.max_depth, __ATOMIC_RELAXED);
+    while (depth > max_depth
+            && !__atomic_compare_exchange_n(&stats.max_depth, &max_depth, depth, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+
+/**
+ * Runs MCTS iterations on the shared tree until the root has enough visits, as one of the SEARCH_THREADS search threads.
+ * The leaf selected by an iteration is expanded by the first thread claiming it ; the other threads selecting it meanwhile
+ * only remove their virtual losses.
+*/
+static void search_worker(void* arg) {
+    (void) arg;
+    while (node_visits(tree_root) < search_goal && !can_stop_early() && __atomic_fetch_add(&stats.iterations, 1, __ATOMIC_RELAXED) < MAX_VISITS) {
+        uint64_t t0 = (stats_output != NULL) ? now_ns() : 0;
+        node_t* leaf = parallel_selection(tree_root);
+        uint64_t t1 = (stats_output != NULL) ? now_ns() : 0, t2 = t1;
+        uint64_t simulation_ns = thread_simulation_ns;
+        uint8_t not_expanded = NOT_EXPANDED;
+        if (winner(leaf->state) >= 0) MTCS_backpropagation(leaf);    // nothing to expand
+        else if (__atomic_compare_exchange_n(&leaf->expansion, &not_expanded, EXPANDING, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            MCTS_expansion_simulation(leaf);
+            uint32_t incr_wins, incr_visits;
+            expansion_results(leaf, &incr_wins, &incr_visits);    // before the other threads can update the children
+            __atomic_store_n(&leaf->expansion, EXPANDED, __ATOMIC_RELEASE);
+            if (stats_output != NULL) t2 = now_ns();
+            backpropagate(leaf, incr_wins, incr_visits);
+        }
+        for (node_t* n = leaf; n != tree_root; n = parent_of(n)) virtual_loss(n, 1);
+        if (stats_output != NULL) {
+            record_step_times(t0, t1, t2, now_ns(), simulation_ns);
+            record_depth(leaf);
+        }
+    }
+}
+
+
+/**
+ * Runs the iterations of the MCTS algorithm on SEARCH_THREADS threads : the calling thread and SEARCH_THREADS-1 tasks
+ * of the thread pool.
+*/
+static void parallel_search() {
+    task_group_t group = {0};
+    for (uint8_t t = 1; t < SEARCH_THREADS; t++) pool_submit(&group, search_worker, NULL);
+    search_worker(NULL);
+    pool_wait(&group);
+    if (stats.iterations > MAX_VISITS) stats.iterations = MAX_VISITS;    // the threads stopping overshoot the counter
+}
+
+
+/**
+ * Runs the iterations of the MCTS algorithm on the calling thread, LEAVES_PER_BATCH at a time : the leaves are selected with
+ * virtual losses on their paths, then all those not being expanded yet are expanded by one call to the evaluator, and the
+ * results of all of them are backpropagated before their virtual losses are removed.
+*/
+static void batched_search() {
+    uint32_t loops = 0;
+    while (node_visits(tree_root) < search_goal && loops < MAX_VISITS && !can_stop_early()) {
+        node_t* selected[MAX_LEAVES_PER_BATCH];
+        node_t* claimed[MAX_LEAVES_PER_BATCH];    // the selected leaves to expand, each once
+        uint8_t nb_selected = 0, nb_claimed = 0;
+        uint64_t t0 = (stats_output != NULL) ? now_ns() : 0;
+        for (; nb_selected < LEAVES_PER_BATCH && loops < MAX_VISITS; loops++) {
+            node_t* leaf = parallel_selection(tree_root);
+            selected[nb_selected++] = leaf;
+            uint8_t not_expanded = NOT_EXPANDED;
+            if (winner(leaf->state) < 0 && __atomic_compare_exchange_n(&leaf->expansion, &not_expanded, EXPANDING, 0,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                claimed[nb_claimed++] = leaf;
+        }
+
+        uint64_t t1 = (stats_output != NULL) ? now_ns() : 0;
+        uint64_t simulation_ns = thread_simulation_ns;
+        evaluated_expansion(claimed, nb_claimed);
+        for (uint8_t l = 0; l < nb_claimed; l++) __atomic_store_n(&claimed[l]->expansion, EXPANDED, __ATOMIC_RELEASE);
+        uint64_t t2 = (stats_output != NULL) ? now_ns() : 0;
+        for (uint8_t l = 0; l < nb_selected; l++) {
+            node_t* leaf = selected[l];
+            if (stats_output != NULL) record_depth(leaf);    // before the virtual losses, while the path is the one selected
+            if (winner(leaf->state) >= 0) MTCS_backpropagation(leaf);
+            for (node_t* n = leaf; n != tree_root; n = parent_of(n)) virtual_loss(n, 1);
+        }
+        for (uint8_t l = 0; l < nb_claimed; l++) MTCS_backpropagation(claimed[l]);
+        if (stats_output != NULL) record_step_times(t0, t1, t2, now_ns(), simulation_ns);
     }
+    stats.iterations = loops;
+}
+
+
+// ============= SEARCH ============
+
+
+/**
+ * Same as the progression of progress_in_tree, within the depth of the tree file : tree_root stays attached to its parent,
+ * and the other children of the old root are only trimmed to the depth the tree file keeps.
+ * 
+ * @param selected_col the move that has been played in [0, ROW_LENGTH[. Is assumed to be valid
+*/
+static void progress_in_file_tree(col_t selected_col) {
+    node_t* selected_node = child_of(tree_root, selected_col);
+    if (selected_node == NULL) {
+        selected_node = create_node_and_simulate(play_copy_auto(tree_root->state, selected_col), tree_root, selected_col);
+        if (selected_node != NULL) {
+            set_child(tree_root, selected_col, selected_node);
+            backpropagate(tree_root, node_wins(selected_node), node_visits(selected_node));
+        }
+    }
+    for (col_t col = 0; col < ROW_LENGTH; col++)
+        if (col != selected_col && tree_root->children[col] != NO_NODE)
+            trim_node(child_of(tree_root, col), TREE_FILE_MAX_DEPTH-file_depth-1);
+    file_depth++;
+    tree_root = selected_node;
 }
 
 
@@ -307,7 +1212,7 @@ static void MTCS_backpropagation(node_t* selected_old_leaf) {
  * If no simulations were made for that game playout, creates a new node accordingly and sets it as the tree_root.
  * WARNING : If the move represented by selected_col is invalid, the new tree_root will be set to NULL.
  * 
- * @param selected_col the move that has been played in [0, 6]. Is assumed to be valid
+ * @param selected_col the move that has been played in [0, ROW_LENGTH[. Is assumed to be valid
 */
 static void progress_in_tree(col_t selected_col) {
     /* 
@@ -321,19 +1226,22 @@ static void progress_in_tree(col_t selected_col) {
     */
     col_t c = selected_col;    // For shorter notations in this section
     for (col_t y = 0; y < ROW_LENGTH; y++) {
-        if (y == c || tree_root->children[y] == NULL) continue;
+        node_t* node_y = child_of(tree_root, y);    // the node "tree_root -> Y"
+        if (y == c || node_y == NULL) continue;
         for (col_t x = 0; x < ROW_LENGTH; x++) {
 
             // Ignore Y-X pair if invalid Y-X-C trio or if no data for "tree_root -> Y -> X -> C"
 
+            node_t* node_yx = child_of(node_y, x);    // the node "tree_root -> Y -> X"
             if (    x == y 
                     || x == c 
-                    || tree_root->children[y]->children[x] == NULL
-                    || tree_root->children[y]->children[x]->children[c] == NULL
+                    || node_yx == NULL
+                    || node_yx->children[c] == NO_NODE
             ) continue;
 
-            uint32_t merged_nb_wins = tree_root->children[y]->children[x]->children[c]->nb_wins;
-            uint32_t merged_nb_visits = tree_root->children[y]->children[x]->children[c]->nb_visits;
+            packed_stats_t merged = load_stats(child_of(node_yx, c));
+            uint32_t merged_nb_wins = packed_wins(merged);
+            uint32_t merged_nb_visits = packed_visits(merged);
 
             // If no data yet for the C-X-Y trio, try creating the appropriate nodes. Ignore C-X-Y trio if it fails
             node_t* prnt = tree_root;    // parent node
@@ -341,85 +1249,172 @@ static void progress_in_tree(col_t selected_col) {
             col_t chldrn[3] = {c, x, y};    // the indices of the sub-children to consider (in order) to reach "tree_root -> C -> X -> Y"
             for (uint8_t i = 0; i < 3; i++) {
                 col_t idx = chldrn[i];    // the index of the child to create (if it does not already exist)
-                if (prnt->children[idx] != NULL) {
+                if (prnt->children[idx] != NO_NODE) {
                     // Node already exists
-                    prnt = prnt->children[idx];
+                    prnt = child_of(prnt, idx);
                     continue;    
                 }
 
                 // Attempt to create the new child node
-                node_t* child = create_node_and_simulate(play_copy_auto(prnt->state, idx), prnt);
+                node_t* child = create_node_and_simulate(play_copy_auto(prnt->state, idx), prnt, idx);
                 if (child == NULL) {    
                     // Node creation failed
                     does_node_cxy_exist = 0;
                     break;
                 }
-                prnt->children[idx] = child;
+                set_child(prnt, idx, child);
 
                 // Backpropagation of the data of the new child
-                for (node_t* n = prnt; n != NULL; n = n->parent) {
-                    n->nb_visits += child->nb_visits;
-                    n->nb_wins += child->nb_wins;
-                }
-                prnt = prnt->children[idx];
+                backpropagate(prnt, node_wins(child), node_visits(child));
+                prnt = child;
             }
             if (!does_node_cxy_exist) continue;    // Failed to create the node "tree_root -> C -> X -> Y"
 
             /* Finally, adds the simulations data of "tree_root -> Y -> X -> C" to the data of "tree_root -> C -> X -> Y"
             and backpropagates them */
             nb_recombined_visits += merged_nb_visits;
-            for (node_t* node = tree_root->children[c]->children[x]->children[y]; node != NULL; node = node->parent) {
-                node->nb_visits += merged_nb_visits;
-                node->nb_wins += merged_nb_wins;
-            }
+            backpropagate(prnt, merged_nb_wins, merged_nb_visits);
             
         }
     }
 
+    // Within the depth of the tree file, the old root stays in the tree to be written, with the other children it keeps
+    if (file_root != NULL && file_depth < TREE_FILE_MAX_DEPTH) {
+        progress_in_file_tree(selected_col);
+        return;
+    }
+    if (file_root != NULL) leave_file_tree();
+
     // Actually rogressing into the tree
-    node_t* selected_node = tree_root->children[selected_col];
-    if (selected_node == NULL) selected_node = create_node_and_simulate(play_copy_auto(tree_root->state, selected_col), NULL);
-    tree_root->children[selected_col] = NULL;
+    node_t* selected_node = child_of(tree_root, selected_col);
+    if (selected_node == NULL) selected_node = create_node_and_simulate(play_copy_auto(tree_root->state, selected_col), NULL, 0);
+    else {
+        // Its statistics move from the children_stats of the old root to the block of the root
+        root_stats.lanes[0] = load_stats(selected_node);
+        selected_node->parent = NO_NODE;
+        selected_node->index = 0;
+    }
+    tree_root->children[selected_col] = NO_NODE;
     recursive_node_destroy(tree_root);
-    selected_node->parent = NULL;
     tree_root = selected_node;
 }
 
 
+/**
+ * Writes the statistics of the latest run of the MCTS algorithm as one line of JSON on stats_output.
+ * 
+ * @param selected_col the move selected by the MCTS algorithm, or -1 if none
+ * @param total_ns the duration of the run
+*/
+static void write_stats(col_t selected_col, uint64_t total_ns) {
+    uint8_t ply = tree_root->state->ply;
+    fprintf(stats_output, "{\"ply\":%u,\"choice\":%d,\"iterations\":%u,\"stopped_early\":%s,\"playouts\":%lu,\"evaluations\":%lu,\"playouts_per_s\":%.0f,"
+            "\"nodes_allocated\":%lu,\"root_visits\":%u,\"recombined_visits\":%u,\"max_depth\":%u,\"depth_histogram\":[",
+            ply, selected_col, stats.iterations, stats.stopped_early ? "true" : "false", stats.playouts, stats.evaluations, (total_ns > 0) ? stats.playouts * 1e9 / total_ns : 0.0,
+            stats.nodes_allocated, node_visits(tree_root), nb_recombined_visits, stats.max_depth);
+    for (uint8_t depth = 0; depth <= stats.max_depth; depth++)
+        fprintf(stats_output, (depth == 0) ? "%u" : ",%u", stats.depth_histogram[depth]);
+    fprintf(stats_output, "],\"time_ms\":{\"total\":%.3f,\"selection\":%.3f,\"expansion\":%.3f,"
+            "\"simulation\":%.3f,\"backpropagation\":%.3f}",
+            total_ns / 1e6, stats.selection_ns / 1e6, stats.expansion_ns / 1e6,
+            stats.simulation_ns / 1e6, stats.backpropagation_ns / 1e6);
+
+    // The activity of the thread pool during the search, summed over its workers
+    worker_counters_t counters[POOL_MAX_WORKERS];
+    worker_counters_t total = {0, 0, 0, 0};
+    uint8_t nb_workers = pool_counters(counters, 0);
+    for (uint8_t i = 0; i < nb_workers; i++) {
+        total.tasks += counters[i].tasks;
+        total.steals += counters[i].steals;
+        total.failed_steals += counters[i].failed_steals;
+        total.idle_ns += counters[i].idle_ns;
+    }
+    fprintf(stats_output, ",\"pool\":{\"workers\":%u,\"tasks\":%lu,\"steals\":%lu,\"failed_steals\":%lu,\"idle_ms\":%.3f}}\n",
+            nb_workers, total.tasks, total.steals, total.failed_steals, total.idle_ns / 1e6);
+    fflush(stats_output);
+}
+
+
+/**
+ * Runs the iterations of the MCTS algorithm on the calling thread, timing each step if the statistics are requested.
+*/
+static void sequential_search() {
+    uint32_t loops = 0;    // there to prevent infinite loops when the selected node won't change or in case of draw
+    while (node_visits(tree_root) < search_goal && loops < MAX_VISITS && !can_stop_early()) {
+        if (stats_output == NULL) {
+            node_t* selected = MCTS_selection(tree_root);
+            MCTS_expansion_simulation(selected);
+            MTCS_backpropagation(selected);
+        } else {
+            // Same steps, timed
+            uint64_t t0 = now_ns();
+            node_t* selected = MCTS_selection(tree_root);
+            uint64_t t1 = now_ns();
+            uint64_t simulation_ns = thread_simulation_ns;
+            MCTS_expansion_simulation(selected);
+            uint64_t t2 = now_ns();
+            MTCS_backpropagation(selected);
+            record_step_times(t0, t1, t2, now_ns(), simulation_ns);
+            record_depth(selected);
+        }
+        loops++;
+    }
+    stats.iterations = loops;
+}
+
+
 /**
  * Fills the global variable tree_root using the MCTS algorithm. Then, selects the best estimated move, adapts tree_root
  * to take notice of that selection, and returns the selected move. Assumes it is the AI's turn to play.
  * 
- * @returns the column in [0-6] selected by the MCTS algorithm to play. Running this function adds to to the tree,
+ * @returns the column in [0, ROW_LENGTH[ selected by the MCTS algorithm to play. Running this function adds to to the tree,
  * but does NOT update tree_root according to the returned column.
  * MCTS_FAIL if the MCTS algorithm applicaiton fails (extreme error)
 */
 static col_t MCTS() {
-    // Runs the algorithm
-    uint32_t loops = 0;    // there to prevent infinite loops when the selected node won't change or in case of draw
-    while (tree_root->nb_visits < MAX_VISITS-7 && loops < MAX_VISITS) {
-        node_t* selected = MCTS_selection(tree_root);
-        MCTS_expansion_simulation(selected);
-        MTCS_backpropagation(selected);
-        loops++;
+    search_stats_t empty_stats = {0};
+    stats = empty_stats;
+    uint64_t search_start = now_ns();
+
+    // Within the depth of a tree file, each search adds its visits to those of the file, so that they accumulate
+    uint32_t start_visits = (file_root != NULL) ? node_visits(tree_root) : 0;
+    search_goal = (start_visits < UINT32_MAX - MAX_VISITS) ? start_visits + MAX_VISITS - ROW_LENGTH : UINT32_MAX - ROW_LENGTH;
+
+    // The thread pool runs all the threads but the calling one
+    uint8_t nb_workers = ((SEARCH_THREADS > SIMULATION_THREADS) ? SEARCH_THREADS : SIMULATION_THREADS) - 1;
+    if (nb_workers == 0) pool_stop();
+    else if (pool_start(nb_workers, PIN_THREADS) > 0) {
+        worker_counters_t counters[POOL_MAX_WORKERS];
+        pool_counters(counters, 1);    // resets the counters for the statistics of this search
     }
 
+    // Runs the algorithm
+    if (SEARCH_THREADS > 1) parallel_search();
+    else if (EVALUATOR != NULL && LEAVES_PER_BATCH > 1) batched_search();
+    else sequential_search();
+    stats.stopped_early = (node_visits(tree_root) < search_goal && can_stop_early());
+
     // Selects the most visited move
-    uint32_t max_visits = 0;
+    uint32_t max_visits = 0, max_wins = 0;
     col_t selected_col = -1;
     for (col_t col = 0; col < ROW_LENGTH; col++) {
-        node_t* tested = tree_root->children[col];
-        if (tested == NULL) continue;
-        boolean has_more_visits = (tested->nb_visits > max_visits);
-        boolean has_same_visits_more_wins = (tested->nb_visits == max_visits && tested->nb_wins > tree_root->children[selected_col]->nb_wins);
+        root_visits[col] = 0;
+        if (tree_root->children[col] == NO_NODE) continue;
+        packed_stats_t packed = load_stats(child_of(tree_root, col));
+        root_visits[col] = packed_visits(packed);
+        boolean has_more_visits = (packed_visits(packed) > max_visits);
+        boolean has_same_visits_more_wins = (selected_col >= 0 && packed_visits(packed) == max_visits 
+                && packed_wins(packed) > max_wins);
         if (has_more_visits || has_same_visits_more_wins) {
-            max_visits = tested->nb_visits;
+            max_visits = packed_visits(packed);
+            max_wins = packed_wins(packed);
             selected_col = col;
         }
     }
+    if (stats_output != NULL) write_stats(selected_col, now_ns() - search_start);
     if (selected_col == -1) return MCTS_FAIL;
     
-    printf("\n<<<<< %d visits of root node before progression >>>>>\n", tree_root->nb_visits);   // DEBUG DEBUG DEBUG
+    printf("\n<<<<< %d visits of root node before progression >>>>>\n", node_visits(tree_root));   // DEBUG DEBUG DEBUG
     return selected_col;
 }
 
@@ -431,68 +1426,223 @@ static col_t MCTS() {
 */
 
 
-col_t init_MCTS(player_t playing_as, uint32_t max_visits) {
-    if (max_visits < 8 || (playing_as != PLAYER_A && playing_as != PLAYER_B)) return ARG_ERROR;
+/**
+ * Creates a fresh MCTS tree for a new game, with one simulation for the root and one for each of its children.
+ * 
+ * @returns the root of the tree;
+ * NULL in case of memory allocation error.
+*/
+static node_t* create_fresh_tree() {
     game_t* init_game = game_init();
-    if (init_game == NULL) return MEMERROR;
-    PLAYING_AS = playing_as;
-    MAX_VISITS = max_visits;
+    if (init_game == NULL) return NULL;
 
-    tree_root = create_node_and_simulate(init_game, NULL);
-    if (tree_root == NULL) {
+    node_t* root = create_node_and_simulate(init_game, NULL, 0);
+    if (root == NULL) {
         free(init_game);
-        return MEMERROR;
+        return NULL;
     }
 
     // Initialising the first possible paths
     for (col_t col = 0; col < ROW_LENGTH; col++) {
         game_t* game_continuation = play_copy_auto(init_game, col);
         if (game_continuation == NULL) {    // memory alloc error, because invalid move is supposed impossible here
-            recursive_node_destroy(tree_root);
+            recursive_node_destroy(root);
+            return NULL;
         }
-        node_t* new_child = create_node_and_simulate(game_continuation, tree_root);
+        node_t* new_child = create_node_and_simulate(game_continuation, root, col);
         if (new_child != NULL) {
-            tree_root->children[col] = new_child;
-            tree_root->nb_visits += new_child->nb_visits;
-            tree_root->nb_wins += new_child->nb_wins;
+            set_child(root, col, new_child);
+            backpropagate(root, node_wins(new_child), node_visits(new_child));
         }
     }
+    return root;
+}
+
 
-    // If the IA is PLAYER_A : runs the MCTS from empty game, updates the tree and returns result
-    if (playing_as == PLAYER_A) {
+/**
+ * Makes the AI play its first move if it is its turn to play, once tree_root has been initialised.
+ * 
+ * @returns the values described for 'init_MCTS'
+*/
+static col_t start_MCTS() {
+    if (now_playing(tree_root->state) == PLAYING_AS) {
         col_t first_move = MCTS();
+        if (first_move == MCTS_FAIL) return MCTS_FAIL;
         progress_in_tree(first_move);
         ai_choice = first_move;
         return first_move;
     }
-    else return ROW_LENGTH;    // implicit playing_as == PLAYER_B
+    else return ROW_LENGTH;
+}
+
+
+col_t init_MCTS(player_t playing_as, uint32_t max_visits) {
+    return init_MCTS_from_file(playing_as, max_visits, NULL);
+}
+
+
+col_t init_MCTS_from_file(player_t playing_as, uint32_t max_visits, const char* path) {
+    if (max_visits < 8 || (playing_as != PLAYER_A && playing_as != PLAYER_B)) return ARG_ERROR;
+    PLAYING_AS = playing_as;
+    MAX_VISITS = max_visits;
+    tree_root = NULL;
+    file_root = NULL;
+    file_depth = 0;
+    free(tree_file_path);
+    tree_file_path = NULL;
+
+    // Warm start from the tree file, if any
+    if (path != NULL) {
+        tree_file_path = strdup(path);
+        game_t* init_game = game_init();
+        if (tree_file_path == NULL || init_game == NULL) {
+            free(init_game);
+            return MEMERROR;
+        }
+        tree_root = read_tree(path, init_game);
+        if (tree_root == NULL && access(path, F_OK) == 0) {
+            // Saved for another board or role, or corrupted : the file may hold the work of many sessions, so it is kept
+            fprintf(stderr, "The tree file %s can't be used by this game : it is left unchanged\n", path);
+            free(tree_file_path);
+            tree_file_path = NULL;
+        }
+    }
+    if (tree_root == NULL) tree_root = create_fresh_tree();
+    if (tree_root == NULL) return MEMERROR;
+    if (tree_file_path != NULL) file_root = tree_root;
+
+    return start_MCTS();
+}
+
+
+col_t init_MCTS_from_opening(player_t playing_as, uint32_t max_visits, const col_t* opening, uint8_t opening_length) {
+    if (max_visits < 8 || (playing_as != PLAYER_A && playing_as != PLAYER_B)) return ARG_ERROR;
+    if (opening == NULL && opening_length > 0) return ARG_ERROR;
+    PLAYING_AS = playing_as;
+    MAX_VISITS = max_visits;
+    file_root = NULL;
+    file_depth = 0;
+    free(tree_file_path);
+    tree_file_path = NULL;
+    tree_root = create_fresh_tree();
+    if (tree_root == NULL) return MEMERROR;
+
+    for (uint8_t i = 0; i < opening_length; i++) {
+        col_t col = opening[i];
+        if (col < 0 || col >= ROW_LENGTH || play_auto_without_update(tree_root->state, col) != 0) {
+            destroy_MCTS();
+            return ARG_ERROR;
+        }
+        progress_in_tree(col);
+    }
+
+    return start_MCTS();
+}
+
+
+void set_MCTS_exploration(double exploration) {
+    EXPLORATION = exploration;
+}
+
+
+void set_MCTS_policy(policy_function_t policy, double c_puct) {
+    POLICY = policy;
+    C_PUCT = c_puct;
+}
+
+
+void set_MCTS_evaluator(evaluator_function_t evaluator, uint8_t visits_per_evaluation, uint8_t leaves_per_batch) {
+    if (visits_per_evaluation < 1) visits_per_evaluation = 1;
+    if (leaves_per_batch < 1) leaves_per_batch = 1;
+    if (leaves_per_batch > MAX_LEAVES_PER_BATCH) leaves_per_batch = MAX_LEAVES_PER_BATCH;
+    EVALUATOR = evaluator;
+    VISITS_PER_EVALUATION = visits_per_evaluation;
+    LEAVES_PER_BATCH = leaves_per_batch;
+}
+
+
+void set_MCTS_progressive_bias(double weight) {
+    PROGRESSIVE_BIAS = weight;
+}
+
+
+void set_MCTS_batch_playouts(uint8_t playouts_per_child) {
+    BATCH_PLAYOUTS = playouts_per_child;
+}
+
+
+void set_MCTS_simulation_threads(uint8_t nb_threads) {
+    if (nb_threads < 1) nb_threads = 1;
+    if (nb_threads > MAX_SIMULATION_THREADS) nb_threads = MAX_SIMULATION_THREADS;
+    SIMULATION_THREADS = nb_threads;
+}
+
+
+void set_MCTS_search_threads(uint8_t nb_threads) {
+    if (nb_threads < 1) nb_threads = 1;
+    if (nb_threads > MAX_SEARCH_THREADS) nb_threads = MAX_SEARCH_THREADS;
+    SEARCH_THREADS = nb_threads;
+}
+
+
+void set_MCTS_early_stop(boolean enabled, double confidence) {
+    EARLY_STOP = enabled;
+    EARLY_STOP_CONFIDENCE = confidence;
+}
+
+
+void set_MCTS_pin_threads(boolean pin) {
+    PIN_THREADS = pin;
+}
+
+
+void set_MCTS_stats_output(FILE* output) {
+    stats_output = output;
+}
+
+
+void get_MCTS_root_visits(uint32_t visits[ROW_LENGTH]) {
+    for (col_t col = 0; col < ROW_LENGTH; col++) visits[col] = root_visits[col];
+}
+
+
+int8_t save_MCTS(const char* path, uint8_t max_depth) {
+    if (path == NULL || tree_root == NULL) return ARG_ERROR;
+    return write_tree(path, tree_root, max_depth);
 }
 
 
 void destroy_MCTS() {
+    pool_stop();
+    if (file_root != NULL) leave_file_tree();
     recursive_node_destroy(tree_root);
+    tree_root = NULL;
+    arena_reset();
 }
 
 
 col_t input_MCTS(col_t col) {
     if (col < 0 || col >= ROW_LENGTH) return ARG_ERROR;
-    if (tree_root->children[col] == NULL) return -1;
+    // The move may be valid even if it was never explored : progress_in_tree then creates its node
+    if (tree_root->children[col] == NO_NODE && play_auto_without_update(tree_root->state, col) < 0) return -1;
     nb_recombined_visits = 0;
     progress_in_tree(col);
 
     col_t col_to_play;
 
-    // If the AI can make a Connect4 in the immediate state -> exploit it
-    col_to_play = can_make_connect4_now(tree_root->state);
-    if (col_to_play >= 0) {
+    // If the AI can make a Connect4 in the immediate state -> exploit it (in the leftmost column, if there are several)
+    uint16_t forced_columns = can_make_connect4_now(tree_root->state);
+    if (forced_columns != 0) {
+        col_to_play = __builtin_ctz(forced_columns);
         progress_in_tree(col_to_play);
         MCTS();
         ai_choice = col_to_play;
         return col_to_play;
     }
     // If the human is threatening to make a connect4, and the AI absolutely needs to avert it
-    col_to_play = does_latest_player_threaten_to_connect4(tree_root->state);
-    if (col_to_play >= 0) {
+    forced_columns = does_latest_player_threaten_to_connect4(tree_root->state);
+    if (forced_columns != 0) {
+        col_to_play = __builtin_ctz(forced_columns);
         progress_in_tree(col_to_play);
         MCTS();
         ai_choice = col_to_play;
@@ -516,7 +1666,7 @@ void print_state() {
 
     print_game(tree_root->state);
     printf("=> Confidence : %.1f %% (%d simulations, including %d merged)\n", 
-            100.0*(double) tree_root->nb_wins/(double) tree_root->nb_visits, 
-            tree_root->nb_visits, 
+            100.0*(double) node_wins(tree_root)/(double) node_visits(tree_root), 
+            node_visits(tree_root), 
             nb_recombined_visits);
 }
\ No newline at end of file
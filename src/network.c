@@ -0,0 +1,261 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../headers/network.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+
+#define CELLS_MASK (((bitboard_t) 1 << NB_CELLS) - 1)
+#define HIDDEN_MAX_VALUE 127
+
+
+/**
+ * The weights of the network. The output weights are widened to int16 when loading, for the int16 dot products.
+*/
+typedef struct network {
+    uint8_t hidden_shift;
+    uint16_t nb_hidden;
+    float output_scale;
+    int16_t* hidden_weights;    // NETWORK_INPUTS rows of nb_hidden
+    int16_t* hidden_biases;
+    int16_t* output_weights;    // NETWORK_OUTPUTS rows of nb_hidden
+    int32_t output_biases[NETWORK_OUTPUTS];
+} network_t;
+
+static network_t* network = NULL;
+
+static const char NETWORK_FILE_MAGIC[4] = {'C', '4', 'N', 'N'};
+static const uint8_t NETWORK_FILE_VERSION = 1;
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+static void destroy_network(network_t* net) {
+    if (net == NULL) return;
+    free(net->hidden_weights);
+    free(net->hidden_biases);
+    free(net->output_weights);
+    free(net);
+}
+
+
+/**
+ * Reads the weights following the header of a weights file.
+ *
+ * @param net the network to fill, whose header fields are already read
+ * @param file the file, just after the header
+ *
+ * @returns 0 in case of success;
+ * NETWORK_ERROR if the file is too short or too long;
+ * MEM_ERROR in case of memory allocation error.
+*/
+static int8_t read_weights(network_t* net, FILE* file) {
+    uint32_t nb_hidden_weights = NETWORK_INPUTS * net->nb_hidden;
+    uint32_t nb_output_weights = NETWORK_OUTPUTS * net->nb_hidden;
+    net->hidden_weights = (int16_t*) malloc(nb_hidden_weights * sizeof(int16_t));
+    net->hidden_biases = (int16_t*) malloc(net->nb_hidden * sizeof(int16_t));
+    net->output_weights = (int16_t*) malloc(nb_output_weights * sizeof(int16_t));
+    int8_t* narrow_weights = (int8_t*) malloc(nb_output_weights * sizeof(int8_t));
+    if (net->hidden_weights == NULL || net->hidden_biases == NULL || net->output_weights == NULL || narrow_weights == NULL) {
+        free(narrow_weights);
+        return MEM_ERROR;
+    }
+
+    boolean complete = fread(net->hidden_weights, sizeof(int16_t), nb_hidden_weights, file) == nb_hidden_weights
+            && fread(net->hidden_biases, sizeof(int16_t), net->nb_hidden, file) == net->nb_hidden
+            && fread(narrow_weights, sizeof(int8_t), nb_output_weights, file) == nb_output_weights
+            && fread(net->output_biases, sizeof(int32_t), NETWORK_OUTPUTS, file) == NETWORK_OUTPUTS
+            && fgetc(file) == EOF;
+    for (uint32_t i = 0; i < nb_output_weights; i++) net->output_weights[i] = narrow_weights[i];
+    free(narrow_weights);
+    return complete ? 0 : NETWORK_ERROR;
+}
+
+
+/**
+ * Lists the inputs set for a position : the disks of the player to move, then those of their opponent.
+ *
+ * @param game the position
+ * @param active filled with the indices of the inputs set, in increasing order
+ *
+ * @returns the number of inputs set
+*/
+static uint8_t active_inputs(game_t* game, uint16_t active[NETWORK_INPUTS]) {
+    boolean a_moves = (now_playing(game) == PLAYER_A);
+    bitboard_t boards[2] = {
+        (bitboard_t) (a_moves ? game->gridA : game->gridB) & CELLS_MASK,
+        (bitboard_t) (a_moves ? game->gridB : game->gridA) & CELLS_MASK
+    };
+    uint8_t nb_active = 0;
+    for (uint8_t side = 0; side < 2; side++)
+        for (bitboard_t bits = boards[side]; bits != 0; bits &= bits-1)
+            active[nb_active++] = side*NB_CELLS + bitboard_lowest_bit(bits);
+    return nb_active;
+}
+
+
+/**
+ * Computes the hidden layer of the network for a position.
+ *
+ * @param active the indices of the inputs set
+ * @param nb_active the number of inputs set
+ * @param hidden filled with the nb_hidden values of the hidden layer, in [0, HIDDEN_MAX_VALUE]
+*/
+static void forward_hidden(const uint16_t* active, uint8_t nb_active, int16_t* hidden) {
+    uint16_t nb_hidden = network->nb_hidden;
+#ifdef __AVX2__
+    const __m128i shift = _mm_cvtsi32_si128(network->hidden_shift);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_value = _mm256_set1_epi16(HIDDEN_MAX_VALUE);
+    for (uint16_t h = 0; h < nb_hidden; h += 16) {
+        __m256i sums = _mm256_loadu_si256((const __m256i*) (network->hidden_biases + h));
+        for (uint8_t i = 0; i < nb_active; i++)
+            sums = _mm256_add_epi16(sums,
+                    _mm256_loadu_si256((const __m256i*) (network->hidden_weights + active[i]*nb_hidden + h)));
+        sums = _mm256_min_epi16(_mm256_max_epi16(_mm256_sra_epi16(sums, shift), zero), max_value);
+        _mm256_storeu_si256((__m256i*) (hidden + h), sums);
+    }
+#else
+    for (uint16_t h = 0; h < nb_hidden; h++) {
+        int16_t sum = network->hidden_biases[h];
+        for (uint8_t i = 0; i < nb_active; i++) sum += network->hidden_weights[active[i]*nb_hidden + h];    // wraps like the int16 lanes
+        sum >>= network->hidden_shift;
+        hidden[h] = (sum < 0) ? 0 : (sum > HIDDEN_MAX_VALUE) ? HIDDEN_MAX_VALUE : sum;
+    }
+#endif
+}
+
+
+/**
+ * Computes the outputs of the network from its hidden layer.
+ *
+ * @param hidden the values of the hidden layer
+ * @param outputs filled with the int32 outputs, before the scaling by output_scale
+*/
+static void forward_outputs(const int16_t* hidden, int32_t outputs[NETWORK_OUTPUTS]) {
+    uint16_t nb_hidden = network->nb_hidden;
+    for (uint8_t o = 0; o < NETWORK_OUTPUTS; o++) {
+        const int16_t* weights = network->output_weights + o*nb_hidden;
+#ifdef __AVX2__
+        __m256i sums = _mm256_setzero_si256();
+        for (uint16_t h = 0; h < nb_hidden; h += 16)
+            sums = _mm256_add_epi32(sums, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*) (hidden + h)),
+                    _mm256_loadu_si256((const __m256i*) (weights + h))));
+        __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+        outputs[o] = network->output_biases[o] + _mm_cvtsi128_si32(half);
+#else
+        int32_t sum = network->output_biases[o];
+        for (uint16_t h = 0; h < nb_hidden; h++) sum += hidden[h] * weights[h];
+        outputs[o] = sum;
+#endif
+    }
+}
+
+
+/**
+ * Converts the move logits of the network to priors : their softmax over the valid moves.
+*/
+static void logits_to_priors(game_t* game, const int32_t outputs[NETWORK_OUTPUTS], float priors[ROW_LENGTH]) {
+    float max_logit = -INFINITY, sum = 0.0f;
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        float logit = outputs[1+col] * network->output_scale;
+        if (game->cols_occupation[col] < COL_HEIGHT && logit > max_logit) max_logit = logit;
+    }
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        priors[col] = (game->cols_occupation[col] < COL_HEIGHT)
+                ? expf(outputs[1+col] * network->output_scale - max_logit) : 0.0f;
+        sum += priors[col];
+    }
+    for (col_t col = 0; col < ROW_LENGTH; col++) priors[col] = (sum > 0) ? priors[col] / sum : 0.0f;
+}
+
+
+/*
+===========================================
+=================== API ===================
+===========================================
+*/
+
+
+int8_t load_network(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return ARG_ERROR;
+
+    network_t* net = (network_t*) calloc(1, sizeof(network_t));
+    if (net == NULL) {
+        fclose(file);
+        return MEM_ERROR;
+    }
+    char magic[4];
+    uint8_t version;
+    boolean valid_header = fread(magic, sizeof(char), 4, file) == 4
+            && fread(&version, sizeof(uint8_t), 1, file) == 1
+            && fread(&net->hidden_shift, sizeof(uint8_t), 1, file) == 1
+            && fread(&net->nb_hidden, sizeof(uint16_t), 1, file) == 1
+            && fread(&net->output_scale, sizeof(float), 1, file) == 1;
+    int8_t res = NETWORK_ERROR;
+    if (valid_header
+            && magic[0] == NETWORK_FILE_MAGIC[0] && magic[1] == NETWORK_FILE_MAGIC[1]
+            && magic[2] == NETWORK_FILE_MAGIC[2] && magic[3] == NETWORK_FILE_MAGIC[3]
+            && version == NETWORK_FILE_VERSION
+            && net->hidden_shift < 16
+            && net->nb_hidden > 0 && net->nb_hidden % 16 == 0 && net->nb_hidden <= NETWORK_MAX_HIDDEN
+            && isfinite(net->output_scale))
+        res = read_weights(net, file);
+    fclose(file);
+
+    if (res != 0) {
+        destroy_network(net);
+        return res;
+    }
+    destroy_network(network);
+    network = net;
+    return 0;
+}
+
+
+boolean has_network() {
+    return network != NULL;
+}
+
+
+int8_t network_evaluate(game_t* const* games, uint32_t nb_games, float* values, float (*priors)[ROW_LENGTH]) {
+    if (network == NULL) return NETWORK_ERROR;
+    uint16_t active[NETWORK_INPUTS];
+    int16_t hidden[NETWORK_MAX_HIDDEN];
+    int32_t outputs[NETWORK_OUTPUTS];
+    for (uint32_t i = 0; i < nb_games; i++) {
+        uint8_t nb_active = active_inputs(games[i], active);
+        forward_hidden(active, nb_active, hidden);
+        forward_outputs(hidden, outputs);
+        values[i] = 1.0f / (1.0f + expf(-outputs[0] * network->output_scale));
+        if (priors != NULL) logits_to_priors(games[i], outputs, priors[i]);
+    }
+    return 0;
+}
+
+
+void network_policy(game_t* game, float priors[ROW_LENGTH]) {
+    float value;
+    if (network_evaluate(&game, 1, &value, (float (*)[ROW_LENGTH]) priors) == 0) return;
+
+    uint8_t nb_valid = 0;
+    for (col_t col = 0; col < ROW_LENGTH; col++) nb_valid += (game->cols_occupation[col] < COL_HEIGHT);
+    for (col_t col = 0; col < ROW_LENGTH; col++)
+        priors[col] = (game->cols_occupation[col] < COL_HEIGHT) ? 1.0f / nb_valid : 0.0f;
+}
+
+
+void free_network() {
+    destroy_network(network);
+    network = NULL;
+}
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../headers/game_manager.h"
+#include "../headers/position.h"
+
+/*
+Perft : counts all the move sequences of a given length from a position, and the games they end.
+The counts only depend on the rules of the game, so they check the move generation and the win detection
+against reference counts, and measure the raw speed of the game engine in nodes per second.
+The check also counts the references with the compact position_t representation. The reference counts are those of the
+7x6 board of Connect4 : on the other boards and win lengths, the check only compares the counts of game_t and position_t,
+and skips the references whose moves are invalid or end the game there.
+
+Usage : ./out_perft depth [moves]    (counts from the position reached by playing the columns in 'moves', e.g. 3342)
+        ./out_perft check            (compares the counts with the reference counts ; exits with -1 on mismatch)
+*/
+
+
+/**
+ * The counts of a perft search.
+*/
+typedef struct perft_counts {
+    uint64_t nodes;        // number of move sequences of exactly 'depth' moves
+    uint64_t wins_A;       // number of move sequences ending with a win of PLAYER_A before or at 'depth' moves
+    uint64_t wins_B;       // same for PLAYER_B
+    uint64_t draws;        // same for draws
+} perft_counts_t;
+
+
+#define STANDARD_BOARD (ROW_LENGTH == 7 && COL_HEIGHT == 6 && CONNECT_N == 4)    // whether the reference counts apply
+
+
+/**
+ * A reference count, computed by the original implementation of the game on the 7x6 board.
+*/
+typedef struct perft_reference {
+    const char* moves;
+    uint8_t depth;
+    perft_counts_t counts;
+} perft_reference_t;
+
+
+static const perft_reference_t REFERENCES[] = {
+    {"", 1, {7, 0, 0, 0}},
+    {"", 2, {49, 0, 0, 0}},
+    {"", 3, {343, 0, 0, 0}},
+    {"", 4, {2401, 0, 0, 0}},
+    {"", 5, {16807, 0, 0, 0}},
+    {"", 6, {117649, 0, 0, 0}},
+    {"", 7, {823536, 13032, 0, 0}},
+    {"", 8, {5673234, 13032, 44430, 0}},
+    {"3342", 7, {749587, 39378, 947, 0}},
+    {"33333322", 6, {34193, 1022, 693, 0}},
+    {"3014055360410234564356043035466611", 8, {6, 23, 3, 6}},
+};
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Recursively counts the move sequences of 'depth' moves from 'game', and the games they end.
+ *
+ * @param game the current position. Is assumed not to be finished.
+ * @param depth the number of moves left to play
+ * @param counts the counts to increment
+*/
+static void perft(game_t* game, uint8_t depth, perft_counts_t* counts) {
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        game_t child = *game;
+        int8_t res = play_auto(&child, col);
+        if (res < 0) continue;    // column full
+        if (depth == 1) counts->nodes++;
+        if (res == 1) {
+            if (now_playing(game) == PLAYER_A) counts->wins_A++;
+            else counts->wins_B++;
+        }
+        else if (res == 2) counts->draws++;
+        else if (depth > 1) perft(&child, depth-1, counts);
+    }
+}
+
+
+/**
+ * Same as perft, with the compact position_t representation.
+*/
+static void perft_position(position_t position, uint8_t depth, perft_counts_t* counts) {
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        position_t child = position;
+        int8_t res = position_play(&child, col);
+        if (res < 0) continue;    // column full
+        if (depth == 1) counts->nodes++;
+        if (res == 1) {
+            if (position_now_playing(position) == PLAYER_A) counts->wins_A++;
+            else counts->wins_B++;
+        }
+        else if (res == 2) counts->draws++;
+        else if (depth > 1) perft_position(child, depth-1, counts);
+    }
+}
+
+
+static boolean same_games(game_t* a, game_t* b) {
+    boolean same = a->gridA == b->gridA && a->gridB == b->gridB
+            && a->ply == b->ply && a->threats[PLAYER_A] == b->threats[PLAYER_A] && a->threats[PLAYER_B] == b->threats[PLAYER_B];
+    for (col_t col = 0; col < ROW_LENGTH; col++) same = same && a->cols_occupation[col] == b->cols_occupation[col];
+    return same;
+}
+
+
+/**
+ * Recursively checks 'winning_columns' against the moves which win, for the player to move in each position reached
+ * in 'depth' moves or less, and that 'unplay' restores each position exactly.
+ *
+ * @param game the current position. Is assumed not to be finished.
+ * @param depth the number of moves left to play
+ *
+ * @returns the number of positions where 'winning_columns' disagrees with the results of the moves, or which 'unplay'
+ * doesn't restore
+*/
+static uint64_t check_winning_columns(game_t* game, uint8_t depth) {
+    uint64_t nb_mismatches = 0;
+    uint16_t expected = 0;
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        game_t child = *game;
+        int8_t res = play_auto(&child, col);
+        if (res == 1) expected |= 1 << col;
+        else if (res == 0 && depth > 1) nb_mismatches += check_winning_columns(&child, depth-1);
+        if (res >= 0 && (unplay(&child, col) != 0 || !same_games(&child, game))) nb_mismatches++;
+    }
+    return nb_mismatches + (winning_columns(game, now_playing(game)) != expected);
+}
+
+
+/**
+ * Creates the position reached by playing a sequence of moves from the start of the game.
+ *
+ * @param moves the columns of the moves, as a string of digits
+ *
+ * @returns the position;
+ * NULL if a move is invalid or ends the game, or in case of memory allocation error.
+*/
+static game_t* position_from_moves(const char* moves) {
+    game_t* game = game_init();
+    if (game == NULL) return NULL;
+    for (const char* m = moves; *m != '\0'; m++) {
+        if (play_auto(game, *m - '0') != 0) {
+            game_destroy(game);
+            return NULL;
+        }
+    }
+    return game;
+}
+
+
+/**
+ * Runs perft from a position and measures its duration.
+ *
+ * @returns the counts, and sets 'elapsed_ns' to the duration of the search
+*/
+static perft_counts_t timed_perft(game_t* game, uint8_t depth, uint64_t* elapsed_ns) {
+    perft_counts_t counts = {0, 0, 0, 0};
+    uint64_t start = now_ns();
+    perft(game, depth, &counts);
+    *elapsed_ns = now_ns() - start;
+    return counts;
+}
+
+
+static void print_counts(uint8_t depth, perft_counts_t counts, uint64_t elapsed_ns) {
+    printf("%5u %14lu %12lu %12lu %10lu %10.3f %14.0f\n", depth, counts.nodes, counts.wins_A, counts.wins_B,
+            counts.draws, elapsed_ns / 1e9, counts.nodes / (elapsed_ns / 1e9));
+}
+
+
+/**
+ * Compares the counts of the perft of the game with all the reference counts.
+ *
+ * @returns the number of mismatches
+*/
+static uint32_t check_references() {
+    uint32_t nb_mismatches = 0;
+    for (size_t i = 0; i < sizeof(REFERENCES)/sizeof(REFERENCES[0]); i++) {
+        const perft_reference_t* ref = &REFERENCES[i];
+        game_t* game = position_from_moves(ref->moves);
+        if (game == NULL) {
+            // The moves of the references are valid and don't end the game on the 7x6 board only
+            if (STANDARD_BOARD) nb_mismatches++;
+            printf("%-4s [%-16s] the moves are invalid or end the game on this board\n",
+                    STANDARD_BOARD ? "FAIL" : "SKIP", ref->moves);
+            continue;
+        }
+        uint64_t elapsed_ns;
+        perft_counts_t counts = timed_perft(game, ref->depth, &elapsed_ns);
+
+        boolean ok = !STANDARD_BOARD || (counts.nodes == ref->counts.nodes && counts.wins_A == ref->counts.wins_A
+                && counts.wins_B == ref->counts.wins_B && counts.draws == ref->counts.draws);
+        if (!ok) nb_mismatches++;
+        printf("%-4s [%-16s] ", ok ? (STANDARD_BOARD ? "OK" : "") : "FAIL", ref->moves);
+        print_counts(ref->depth, counts, elapsed_ns);
+
+        // Same counts with position_t
+        perft_counts_t position_counts = {0, 0, 0, 0};
+        uint64_t start = now_ns();
+        perft_position(position_from_game(game), ref->depth, &position_counts);
+        elapsed_ns = now_ns() - start;
+        game_destroy(game);
+        ok = position_counts.nodes == counts.nodes && position_counts.wins_A == counts.wins_A
+                && position_counts.wins_B == counts.wins_B && position_counts.draws == counts.draws;
+        if (!ok) nb_mismatches++;
+        printf("%-4s [%-16s] ", ok ? "OK" : "FAIL", "position_t");
+        print_counts(ref->depth, position_counts, elapsed_ns);
+    }
+
+    // The winning columns are checked in the positions of the references, a few moves deep
+    for (size_t i = 0; i < sizeof(REFERENCES)/sizeof(REFERENCES[0]); i++) {
+        game_t* game = position_from_moves(REFERENCES[i].moves);
+        if (game == NULL) continue;    // already reported
+        uint64_t nb_wrong = check_winning_columns(game, (REFERENCES[i].depth < 6) ? REFERENCES[i].depth : 6);
+        game_destroy(game);
+        if (nb_wrong > 0) {
+            printf("FAIL [%-16s] winning_columns or unplay wrong in %lu positions\n", REFERENCES[i].moves, nb_wrong);
+            nb_mismatches++;
+        }
+    }
+    return nb_mismatches;
+}
+
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage : %s depth [moves]\n        %s check\n", argv[0], argv[0]);
+        exit(-1);
+    }
+
+    if (strcmp(argv[1], "check") == 0) {
+        printf("%-4s %-18s %5s %14s %12s %12s %10s %10s %14s\n",
+                "", "position", "depth", "nodes", "wins A", "wins B", "draws", "time (s)", "nodes/s");
+        uint32_t nb_mismatches = check_references();
+        printf("\n%u mismatch(es)\n", nb_mismatches);
+        return (nb_mismatches == 0) ? 0 : -1;
+    }
+
+    uint8_t max_depth = atoi(argv[1]);
+    game_t* game = position_from_moves((argc == 3) ? argv[2] : "");
+    if (game == NULL || max_depth == 0) {
+        fprintf(stderr, "The depth must be positive, and the moves valid and not ending the game\n");
+        exit(-1);
+    }
+
+    printf("%5s %14s %12s %12s %10s %10s %14s\n", "depth", "nodes", "wins A", "wins B", "draws", "time (s)", "nodes/s");
+    for (uint8_t depth = 1; depth <= max_depth; depth++) {
+        uint64_t elapsed_ns;
+        perft_counts_t counts = timed_perft(game, depth, &elapsed_ns);
+        print_counts(depth, counts, elapsed_ns);
+    }
+    game_destroy(game);
+}
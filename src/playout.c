@@ -0,0 +1,265 @@
+#include "../headers/playout.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+
+#if defined(__AVX2__) && !defined(WIDE_BITBOARDS)
+#define VECTOR_PLAYOUTS    // the AVX2 kernel runs on 64-bit lanes : the 128-bit bitboards use the scalar one
+#endif
+
+
+/**
+ * The bitboard masks used by the playouts, with the layout of game_t.
+ * The bit of (col, row) is (1+row)*ROW_LENGTH - col - 1, so the column 'col' is 'column0' shifted right by 'col'.
+*/
+typedef struct playout_masks {
+    bitboard_t board;       // all the cells of the board
+    bitboard_t column0;     // the cells of the column 0
+    bitboard_t starts_right;    // the cells from which CONNECT_N cells to the right (towards lower bits) fit in the row
+    bitboard_t starts_left;     // the cells from which CONNECT_N cells to the left (towards higher bits) fit in the row
+} playout_masks_t;
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+static playout_masks_t compute_masks() {
+    playout_masks_t masks = {0, 0, 0, 0};
+    for (int8_t row = 0; row < COL_HEIGHT; row++) {
+        for (int8_t k = 0; k < ROW_LENGTH; k++) {    // k is the offset of the cell in its row
+            bitboard_t bit = (bitboard_t) 1 << (row*ROW_LENGTH + k);
+            masks.board |= bit;
+            if (k == ROW_LENGTH-1) masks.column0 |= bit;
+            if (k + CONNECT_N-1 < ROW_LENGTH) masks.starts_right |= bit;
+            if (k >= CONNECT_N-1) masks.starts_left |= bit;
+        }
+    }
+    return masks;
+}
+
+
+#ifndef VECTOR_PLAYOUTS
+/**
+ * Returns whether a bitboard contains CONNECT_N aligned disks.
+ * The rows are found at their lowest bit (see 'rows_of_n'), and the masks discard those wrapping around the edges of
+ * the board.
+*/
+static bitboard_t has_n(bitboard_t b, const playout_masks_t* masks) {
+    bitboard_t found = rows_of_n(b, 1) & masks->starts_right;             // horizontal
+    found |= rows_of_n(b, ROW_LENGTH);                                    // vertical
+    found |= rows_of_n(b, ROW_LENGTH+1) & masks->starts_right;            // diagonal
+    found |= rows_of_n(b, ROW_LENGTH-1) & masks->starts_left;             // anti-diagonal
+    return found;
+}
+
+
+static uint64_t xorshift(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+#endif
+
+
+/**
+ * Derives independent non-zero random states from a seed (splitmix64).
+*/
+static uint64_t seed_lane(uint64_t seed, uint32_t lane) {
+    uint64_t z = seed + (lane+1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (z == 0) ? 1 : z;
+}
+
+
+/**
+ * Prepares the bitboards of a playout.
+ *
+ * @param state the initial state
+ * @param player the player for which the wins are counted
+ * @param mover set to the disks of the player whose turn it is
+ * @param other set to the disks of the other player
+ * @param player_moves set to 1 if it is the turn of 'player'
+ *
+ * @returns -1 if the game is not finished yet; 1 if it is won by 'player'; 0 if it is lost or a draw.
+*/
+static int8_t prepare_playout(game_t* state, player_t player, const playout_masks_t* masks,
+        bitboard_t* mover, bitboard_t* other, boolean* player_moves) {
+    player_t w = winner(state);
+    if (w >= 0) return w == player;
+    player_t now = now_playing(state);
+    bitboard_t grid_now = (now == PLAYER_A) ? state->gridA : state->gridB;
+    bitboard_t grid_other = (now == PLAYER_A) ? state->gridB : state->gridA;
+    *mover = grid_now & masks->board;
+    *other = grid_other & masks->board;
+    *player_moves = (now == player);
+    return -1;
+}
+
+
+#ifndef VECTOR_PLAYOUTS
+/**
+ * Runs one playout, one move at a time.
+ *
+ * @returns 1 if the playout is won by 'player' (the player moving first if player_moves is set, the other one otherwise);
+ * 0 if it is lost or a draw
+*/
+static uint8_t scalar_playout(bitboard_t mover, bitboard_t other, boolean player_moves, const playout_masks_t* masks, uint64_t* rng) {
+    while (1) {
+        bitboard_t occupied = mover | other;
+        if (occupied == masks->board) return 0;    // draw
+        bitboard_t cell;
+        do {
+            col_t col = (col_t) (((xorshift(rng) & 0xFFFFFFFF) * ROW_LENGTH) >> 32);
+            bitboard_t empty = ~occupied & (masks->column0 >> col);
+            cell = empty & -empty;    // lowest empty cell of the column ; 0 if it is full
+        } while (cell == 0);
+
+        mover |= cell;
+        if (has_n(mover, masks)) return player_moves;
+        bitboard_t tmp = mover;
+        mover = other;
+        other = tmp;
+        player_moves = !player_moves;
+    }
+}
+#else
+/**
+ * Returns the cells which start a row of CONNECT_N disks in each 64-bit lane, as 'rows_of_n'.
+*/
+static inline __m256i vector_rows_of_n(__m256i disks, uint8_t shift) {
+    __m256i rows = disks;
+    uint8_t length = 1;
+    while (2*length <= CONNECT_N) {
+        rows = _mm256_and_si256(rows, _mm256_srli_epi64(rows, length*shift));
+        length *= 2;
+    }
+    if (length < CONNECT_N) rows = _mm256_and_si256(rows, _mm256_srli_epi64(rows, (CONNECT_N-length)*shift));
+    return rows;
+}
+
+
+/**
+ * Runs PLAYOUT_LANES playouts in lockstep, one move of every board per step.
+ *
+ * @param mover, other, player_moves the boards of each playout, as set by prepare_playout
+ * @param active the lanes in which a playout has to be run
+ * @param rng the random states of the lanes
+ * @param results set to 1 in the lanes won by 'player', and left untouched in the inactive lanes
+*/
+static void avx2_playouts(const uint64_t mover[PLAYOUT_LANES], const uint64_t other[PLAYOUT_LANES],
+        const uint64_t player_moves[PLAYOUT_LANES], const uint64_t active[PLAYOUT_LANES],
+        const playout_masks_t* masks, uint64_t rng[PLAYOUT_LANES], uint8_t results[PLAYOUT_LANES]) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i board = _mm256_set1_epi64x(masks->board);
+    const __m256i column0 = _mm256_set1_epi64x(masks->column0);
+    const __m256i starts_right = _mm256_set1_epi64x(masks->starts_right);
+    const __m256i starts_left = _mm256_set1_epi64x(masks->starts_left);
+    const __m256i nb_cols = _mm256_set1_epi64x(ROW_LENGTH);
+
+    __m256i me = _mm256_loadu_si256((const __m256i*) mover);
+    __m256i opp = _mm256_loadu_si256((const __m256i*) other);
+    __m256i me_is_player = _mm256_loadu_si256((const __m256i*) player_moves);    // all ones in the lanes where 'me' is 'player'
+    __m256i running = _mm256_loadu_si256((const __m256i*) active);
+    __m256i s = _mm256_loadu_si256((const __m256i*) rng);
+    __m256i won = zero;
+
+    while (!_mm256_testz_si256(running, running)) {
+        // Draws end the playouts whose board is full
+        running = _mm256_andnot_si256(_mm256_cmpeq_epi64(_mm256_or_si256(me, opp), board), running);
+
+        // Picks a random non-full column in each running lane
+        __m256i occupied = _mm256_or_si256(me, opp);
+        __m256i pending = running;
+        __m256i cell = zero;
+        while (!_mm256_testz_si256(pending, pending)) {
+            s = _mm256_xor_si256(s, _mm256_slli_epi64(s, 13));
+            s = _mm256_xor_si256(s, _mm256_srli_epi64(s, 7));
+            s = _mm256_xor_si256(s, _mm256_slli_epi64(s, 17));
+            __m256i col = _mm256_srli_epi64(_mm256_mul_epu32(s, nb_cols), 32);
+            __m256i empty = _mm256_andnot_si256(occupied, _mm256_srlv_epi64(column0, col));
+            __m256i lowest = _mm256_and_si256(_mm256_and_si256(empty, _mm256_sub_epi64(zero, empty)), pending);
+            cell = _mm256_or_si256(cell, lowest);
+            pending = _mm256_and_si256(pending, _mm256_cmpeq_epi64(lowest, zero));
+        }
+        me = _mm256_or_si256(me, cell);
+
+        // Win detection, as in has_n
+        __m256i found = _mm256_and_si256(vector_rows_of_n(me, 1), starts_right);
+        found = _mm256_or_si256(found, vector_rows_of_n(me, ROW_LENGTH));
+        found = _mm256_or_si256(found, _mm256_and_si256(vector_rows_of_n(me, ROW_LENGTH+1), starts_right));
+        found = _mm256_or_si256(found, _mm256_and_si256(vector_rows_of_n(me, ROW_LENGTH-1), starts_left));
+
+        __m256i just_won = _mm256_andnot_si256(_mm256_cmpeq_epi64(found, zero), running);
+        won = _mm256_or_si256(won, _mm256_and_si256(just_won, me_is_player));
+        running = _mm256_andnot_si256(just_won, running);
+
+        __m256i tmp = me;
+        me = opp;
+        opp = tmp;
+        me_is_player = _mm256_xor_si256(me_is_player, _mm256_set1_epi64x(-1));
+    }
+
+    _mm256_storeu_si256((__m256i*) rng, s);
+    int won_mask = _mm256_movemask_pd(_mm256_castsi256_pd(won));
+    for (uint8_t lane = 0; lane < PLAYOUT_LANES; lane++)
+        if (active[lane]) results[lane] = (won_mask >> lane) & 1;
+}
+#endif
+
+
+/*
+===========================================
+=================== API ===================
+===========================================
+*/
+
+
+uint32_t run_playouts(game_t* const* states, uint32_t nb_states, player_t player, uint64_t seed, uint8_t* results) {
+    playout_masks_t masks = compute_masks();
+    uint32_t nb_wins = 0;
+
+#ifdef VECTOR_PLAYOUTS
+    uint64_t rng[PLAYOUT_LANES];
+    for (uint8_t lane = 0; lane < PLAYOUT_LANES; lane++) rng[lane] = seed_lane(seed, lane);
+
+    for (uint32_t first = 0; first < nb_states; first += PLAYOUT_LANES) {
+        uint64_t mover[PLAYOUT_LANES] = {0}, other[PLAYOUT_LANES] = {0};
+        uint64_t player_moves[PLAYOUT_LANES] = {0}, active[PLAYOUT_LANES] = {0};
+        uint8_t lane_results[PLAYOUT_LANES] = {0};
+        for (uint8_t lane = 0; lane < PLAYOUT_LANES && first+lane < nb_states; lane++) {
+            boolean moves;
+            int8_t finished = prepare_playout(states[first+lane], player, &masks, &mover[lane], &other[lane], &moves);
+            if (finished >= 0) lane_results[lane] = finished;
+            else {
+                active[lane] = UINT64_MAX;
+                player_moves[lane] = moves ? UINT64_MAX : 0;
+            }
+        }
+        avx2_playouts(mover, other, player_moves, active, &masks, rng, lane_results);
+        for (uint8_t lane = 0; lane < PLAYOUT_LANES && first+lane < nb_states; lane++) {
+            results[first+lane] = lane_results[lane];
+            nb_wins += lane_results[lane];
+        }
+    }
+#else
+    uint64_t rng = seed_lane(seed, 0);
+    for (uint32_t i = 0; i < nb_states; i++) {
+        bitboard_t mover, other;
+        boolean player_moves;
+        int8_t finished = prepare_playout(states[i], player, &masks, &mover, &other, &player_moves);
+        results[i] = (finished >= 0) ? finished : scalar_playout(mover, other, player_moves, &masks, &rng);
+        nb_wins += results[i];
+    }
+#endif
+
+    return nb_wins;
+}
@@ -0,0 +1,116 @@
+#include "../headers/position.h"
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+/**
+ * Returns the bitboard of the bottom cell of a column.
+*/
+static bitboard_t bottom_cell(col_t col) {
+    return (bitboard_t) 1 << (col*POSITION_COLUMN);
+}
+
+
+/**
+ * Returns the bitboard of the cells of a column, without its sentinel.
+*/
+static bitboard_t column_cells(col_t col) {
+    return ((((bitboard_t) 1 << COL_HEIGHT) - 1) << (col*POSITION_COLUMN));
+}
+
+
+/**
+ * Returns the bitboard of the bottom cells of all the columns.
+*/
+static bitboard_t bottom_row() {
+    bitboard_t row = 0;
+    for (col_t col = 0; col < ROW_LENGTH; col++) row |= bottom_cell(col);
+    return row;
+}
+
+
+/**
+ * Returns the bitboard of all the cells of the board, without the sentinels.
+*/
+static bitboard_t board_cells() {
+    return bottom_row() * (((bitboard_t) 1 << COL_HEIGHT) - 1);
+}
+
+
+/**
+ * Returns whether some disks of a bitboard make a row of CONNECT_N disks.
+*/
+static boolean has_winning_row(bitboard_t disks) {
+    const uint8_t shifts[4] = {1, POSITION_COLUMN, POSITION_COLUMN-1, POSITION_COLUMN+1};
+    for (uint8_t i = 0; i < 4; i++)
+        if (rows_of_n(disks, shifts[i])) return 1;
+    return 0;
+}
+
+
+/*
+===========================================
+=================== API ===================
+===========================================
+*/
+
+
+position_t position_init() {
+    position_t position = {0, 0};
+    return position;
+}
+
+
+position_t position_from_game(game_t* game) {
+    grid_t current_grid = (now_playing(game) == PLAYER_A) ? game->gridA : game->gridB;
+    grid_t all_disks = game->gridA | game->gridB;
+    position_t position = {0, 0};
+    for (col_t col = 0; col < ROW_LENGTH; col++) {
+        for (int8_t row = 0; row < COL_HEIGHT; row++) {
+            uint8_t offset = row*ROW_LENGTH + ROW_LENGTH-1-col;    // the bit of the cell in the grids of game_t
+            bitboard_t bit = bottom_cell(col) << row;
+            if ((all_disks >> offset) & 1) position.mask |= bit;
+            if ((current_grid >> offset) & 1) position.current |= bit;
+        }
+    }
+    return position;
+}
+
+
+player_t position_now_playing(position_t position) {
+    return (bitboard_popcount(position.mask) % 2 == 0) ? PLAYER_A : PLAYER_B;
+}
+
+
+int8_t position_height(position_t position, col_t col) {
+    return bitboard_popcount(position.mask & column_cells(col));
+}
+
+
+uint16_t position_legal_moves(position_t position) {
+    bitboard_t next_cells = (position.mask + bottom_row()) & board_cells();    // a full column overflows into its sentinel
+    uint16_t moves = 0;
+    for (col_t col = 0; col < ROW_LENGTH; col++)
+        if (next_cells & column_cells(col)) moves |= 1 << col;
+    return moves;
+}
+
+
+boolean position_is_full(position_t position) {
+    return position.mask == board_cells();
+}
+
+
+int8_t position_play(position_t* position, col_t col) {
+    if (position->mask & (bottom_cell(col) << (COL_HEIGHT-1))) return -2;
+    // The player to move changes : their disks are the disks of the opponent before the move
+    position->current ^= position->mask;
+    position->mask |= position->mask + bottom_cell(col);
+    if (has_winning_row(position->current ^ position->mask)) return 1;
+    return position_is_full(*position) ? 2 : 0;
+}
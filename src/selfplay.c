@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../headers/mcts.h"
+#include "../headers/network.h"
+
+
+/*
+Self-play training data generator : the MCTS AI plays games against itself, searching every position from a fresh tree
+with the given visit budget, after a few random opening moves. Each searched position is written to the output file as a
+training record, along with the visits of each move at the root of its search and the final result of its game.
+The games are spread over several worker processes, which send the records of each finished game to the main process.
+If the environment variable MCTS_NETWORK names a weights file, the network replaces the playouts (see 'load_network').
+
+The output file starts with a header : TRAINING_FILE_MAGIC, TRAINING_FILE_VERSION, then ROW_LENGTH, COL_HEIGHT and
+CONNECT_N (a byte each) and the size of a record (2 bytes). The training records follow.
+All values are written in the native byte order. The disks are 128-bit words on the boards wider than 64-bit bitboards
+(see WIDE_BITBOARDS), and the records end with zeroed padding bytes up to a multiple of the size of the disks.
+
+Usage : ./out_selfplay output_file nb_games nb_jobs visits [opening_plies [seed]]
+*/
+
+
+static const char TRAINING_FILE_MAGIC[4] = {'C', '4', 'T', 'D'};
+static const uint8_t TRAINING_FILE_VERSION = 2;
+
+#define CELLS_MASK (((bitboard_t) 1 << NB_CELLS) - 1)
+#define RECORD_PADDING ((sizeof(bitboard_t) - (4*ROW_LENGTH+2) % sizeof(bitboard_t)) % sizeof(bitboard_t))
+#define GAME_END_PLY UINT8_MAX    // the ply of the record sent by a worker after each game, which isn't written
+
+_Static_assert(NB_CELLS < GAME_END_PLY, "the ply of a position must not be GAME_END_PLY");
+
+
+/**
+ * A searched position, seen by the player to move. Its bytes (48 on the 7x6 board) are written to the pipe at once, so
+ * the records of the workers never interleave. The padding is explicit, so that no uninitialised byte is written.
+*/
+typedef struct training_record {
+    bitboard_t mover;      // the disks of the player to move, as in grid_t (bits 0 to NB_CELLS-1)
+    bitboard_t opponent;   // the disks of their opponent
+    uint32_t visits[ROW_LENGTH];    // the visits of each move at the root of the search
+    uint8_t ply;           // the number of disks on the board
+    int8_t result;         // 1 if the player to move won the game, 0 if it is a draw, -1 if they lost
+    uint8_t padding[RECORD_PADDING];
+} training_record_t;
+
+_Static_assert(sizeof(training_record_t) == 2*sizeof(bitboard_t) + 4*ROW_LENGTH + 2 + RECORD_PADDING,
+        "the training records must have no implicit padding");
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Plays random moves at the start of a game. The moves never end the game.
+ *
+ * @param game the game in which to play the opening. Is assumed to be a new game.
+ * @param moves filled with the columns of the opening moves
+ * @param opening_length the number of moves to play
+*/
+static void play_random_opening(game_t* game, col_t* moves, uint8_t opening_length) {
+    for (uint8_t i = 0; i < opening_length; i++) {
+        col_t col;
+        do col = random() % ROW_LENGTH;
+        while (play_auto_without_update(game, col) != 0);
+        play_auto(game, col);
+        moves[i] = col;
+    }
+}
+
+
+/**
+ * Plays one self-play game and records its searched positions.
+ *
+ * @param visits the visit budget of each search
+ * @param opening_length the number of random moves played before the searches
+ * @param records filled with the records of the positions searched
+ *
+ * @returns the number of records;
+ * -1 if a search failed.
+*/
+static int8_t play_game(uint32_t visits, uint8_t opening_length, training_record_t records[ROW_LENGTH*COL_HEIGHT]) {
+    game_t* game = game_init();
+    if (game == NULL) return -1;
+    col_t moves[ROW_LENGTH*COL_HEIGHT];
+    play_random_opening(game, moves, opening_length);
+
+    uint8_t nb_moves = opening_length, nb_records = 0;
+    int8_t move_res = 0;
+    while (move_res == 0) {
+        // Each position is searched from a fresh tree, for the player to move
+        player_t mover = now_playing(game);
+        col_t col = init_MCTS_from_opening(mover, visits, moves, nb_moves);
+        destroy_MCTS();
+        if (col < 0 || col >= ROW_LENGTH) {
+            game_destroy(game);
+            return -1;
+        }
+
+        training_record_t* record = &records[nb_records++];
+        memset(record, 0, sizeof(training_record_t));    // also zeroes the padding
+        record->mover = (bitboard_t) ((mover == PLAYER_A) ? game->gridA : game->gridB) & CELLS_MASK;
+        record->opponent = (bitboard_t) ((mover == PLAYER_A) ? game->gridB : game->gridA) & CELLS_MASK;
+        get_MCTS_root_visits(record->visits);
+        record->ply = game->ply;
+        record->result = mover;    // replaced by the result once the game is over
+
+        move_res = play_auto(game, col);
+        moves[nb_moves++] = col;
+    }
+
+    player_t w = winner(game);
+    for (uint8_t i = 0; i < nb_records; i++)
+        records[i].result = (w == DRAW) ? 0 : (w == records[i].result) ? 1 : -1;
+    game_destroy(game);
+    return (move_res < 0) ? -1 : nb_records;
+}
+
+
+/**
+ * The main function of a worker process : plays the games whose index is congruent to 'worker' modulo 'nb_jobs',
+ * and sends their records through a pipe. Each game ends with a record of ply GAME_END_PLY, whose result is 0 if the
+ * game was played and -1 if it failed. Never returns.
+*/
+static void worker_main(int to_parent, uint8_t worker, uint8_t nb_jobs, uint32_t nb_games,
+        uint32_t visits, uint8_t opening_length, uint32_t seed) {
+    // MCTS prints debug information on the standard output : it is not wanted in a worker process
+    if (freopen("/dev/null", "w", stdout) == NULL) _exit(-1);
+    set_MCTS_pin_threads(0);
+
+    training_record_t records[ROW_LENGTH*COL_HEIGHT];
+    training_record_t game_end;
+    memset(&game_end, 0, sizeof(training_record_t));
+    game_end.ply = GAME_END_PLY;
+    for (uint32_t game_index = worker; game_index < nb_games; game_index += nb_jobs) {
+        srandom(seed + game_index);
+        int8_t nb_records = play_game(visits, opening_length, records);
+        for (int8_t i = 0; i < nb_records; i++)
+            if (write(to_parent, &records[i], sizeof(training_record_t)) != sizeof(training_record_t)) _exit(-1);
+        game_end.result = (nb_records < 0) ? -1 : 0;
+        if (write(to_parent, &game_end, sizeof(training_record_t)) != sizeof(training_record_t)) _exit(-1);
+    }
+    _exit(0);
+}
+
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 5 || argc > 7) {
+        fprintf(stderr, "Usage : %s output_file nb_games nb_jobs visits [opening_plies [seed]]\n", argv[0]);
+        exit(-1);
+    }
+    const char* output_path = argv[1];
+    uint32_t nb_games = atoi(argv[2]);
+    uint8_t nb_jobs = atoi(argv[3]);
+    uint32_t visits = atoi(argv[4]);
+    uint8_t opening_length = (argc >= 6) ? atoi(argv[5]) : 2;
+    uint32_t seed = (argc == 7) ? (uint32_t) atoi(argv[6]) : (uint32_t) time(NULL);
+    if (nb_games == 0 || nb_jobs == 0 || visits < 8 || opening_length >= 2*CONNECT_N-1) exit(-1);    // 2*CONNECT_N-1 moves may already end the game
+    if (nb_jobs > nb_games) nb_jobs = nb_games;
+
+    // The network is loaded before the workers are started, which share its weights
+    const char* network_path = getenv("MCTS_NETWORK");
+    if (network_path != NULL) {
+        if (load_network(network_path) != 0) {
+            fprintf(stderr, "Could not load the network %s\n", network_path);
+            exit(-1);
+        }
+        set_MCTS_evaluator(network_evaluate, 16, 8);
+        set_MCTS_policy(network_policy, 1.5);
+    }
+
+    const uint8_t dimensions[3] = {ROW_LENGTH, COL_HEIGHT, CONNECT_N};
+    const uint16_t record_size = sizeof(training_record_t);
+    FILE* output = fopen(output_path, "wb");
+    if (output == NULL
+            || fwrite(TRAINING_FILE_MAGIC, sizeof(char), 4, output) != 4
+            || fwrite(&TRAINING_FILE_VERSION, sizeof(uint8_t), 1, output) != 1
+            || fwrite(dimensions, sizeof(uint8_t), 3, output) != 3
+            || fwrite(&record_size, sizeof(uint16_t), 1, output) != 1) {
+        fprintf(stderr, "Could not write to %s\n", output_path);
+        exit(-1);
+    }
+    printf("%u games, %u jobs, %u visits per search, %u random opening moves, seed %u\n\n",
+            nb_games, nb_jobs, visits, opening_length, seed);
+    fflush(stdout);
+    fflush(output);    // the workers must not inherit the buffered header
+
+    int records_pipe[2];
+    if (pipe(records_pipe) != 0) exit(-1);
+    for (uint8_t worker = 0; worker < nb_jobs; worker++) {
+        pid_t pid = fork();
+        if (pid < 0) exit(-1);
+        if (pid == 0) {
+            close(records_pipe[0]);
+            fclose(output);
+            worker_main(records_pipe[1], worker, nb_jobs, nb_games, visits, opening_length, seed);
+        }
+    }
+    close(records_pipe[1]);
+
+    // Gathering the records
+    uint64_t start = now_ns();
+    uint64_t nb_records = 0;
+    uint32_t nb_finished = 0, nb_failed = 0;
+    training_record_t record;
+    while (read(records_pipe[0], &record, sizeof(record)) == sizeof(record)) {
+        if (record.ply == GAME_END_PLY) {
+            if (record.result < 0) nb_failed++;
+            else nb_finished++;
+            printf("\r%u / %u games played, %u failed, %lu positions, %.0f positions/s", nb_finished, nb_games,
+                    nb_failed, nb_records, nb_records * 1e9 / (now_ns() - start));
+            fflush(stdout);
+            continue;
+        }
+        if (fwrite(&record, sizeof(record), 1, output) != 1) {
+            fprintf(stderr, "\nCould not write to %s\n", output_path);
+            kill(0, SIGTERM);
+            exit(-1);
+        }
+        nb_records++;
+    }
+    close(records_pipe[0]);
+    while (wait(NULL) > 0);
+    free_network();
+    if (fclose(output) != 0) exit(-1);
+
+    double seconds = (now_ns() - start) / 1e9;
+    printf("\r%lu positions written to %s in %.1f s (%.0f positions/s)\n", nb_records, output_path, seconds,
+            nb_records / seconds);
+    if (nb_finished < nb_games) {
+        fprintf(stderr, "%u of the %u games were not recorded (%u failed searches, %u lost by their worker)\n",
+                nb_games - nb_finished, nb_games, nb_failed, nb_games - nb_finished - nb_failed);
+        exit(-1);
+    }
+}
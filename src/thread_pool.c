@@ -0,0 +1,306 @@
+#define _GNU_SOURCE    // for pthread_setaffinity_np
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "../headers/thread_pool.h"
+
+
+#define FAILED_ROUNDS_BEFORE_SLEEP 64    // rounds of steal attempts made by an idle worker before it sleeps
+
+
+typedef struct task {
+    task_function_t function;
+    void* arg;
+    task_group_t* group;
+} task_t;
+
+
+/**
+ * A worker thread and its deque. The tasks of the deque are in [top, bottom[, modulo POOL_DEQUE_CAPACITY :
+ * the worker pushes and pops at the bottom, the thieves take from the top.
+*/
+typedef struct worker {
+    pthread_t thread;
+    pthread_mutex_t lock;    // protects the deque
+    uint32_t top;
+    uint32_t bottom;
+    task_t deque[POOL_DEQUE_CAPACITY];
+    worker_counters_t counters;
+    uint64_t rng;    // for the choice of the workers to steal from
+} worker_t;
+
+
+static worker_t workers[POOL_MAX_WORKERS];
+static uint8_t nb_workers = 0;
+static boolean pinned = 0;
+static boolean stopping = 0;
+static uint32_t next_worker = 0;    // the next worker receiving a task submitted from outside of the pool
+static uint32_t nb_sleeping = 0;
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_up = PTHREAD_COND_INITIALIZER;
+static __thread int16_t current_worker = -1;    // the index of the worker running on this thread ; -1 outside of the pool
+
+
+/*
+===========================================
+============= HELPER FUNCTIONS ============
+===========================================
+*/
+
+
+static uint64_t clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void add_counter(uint64_t* counter, uint64_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+
+static uint32_t deque_size(worker_t* worker) {
+    return __atomic_load_n(&worker->bottom, __ATOMIC_SEQ_CST) - __atomic_load_n(&worker->top, __ATOMIC_SEQ_CST);
+}
+
+
+/**
+ * Pushes a task at the bottom of the deque of a worker.
+ *
+ * @returns 0 if the task was pushed;
+ * -1 if the deque is full.
+*/
+static int8_t push_bottom(worker_t* worker, task_t* task) {
+    pthread_mutex_lock(&worker->lock);
+    if (worker->bottom - worker->top == POOL_DEQUE_CAPACITY) {
+        pthread_mutex_unlock(&worker->lock);
+        return -1;
+    }
+    worker->deque[worker->bottom % POOL_DEQUE_CAPACITY] = *task;
+    __atomic_store_n(&worker->bottom, worker->bottom+1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&worker->lock);
+    return 0;
+}
+
+
+/**
+ * Takes a task from the deque of a worker : the newest one for the worker itself, the oldest one for the other threads.
+ *
+ * @returns 1 if a task was taken and copied into 'task';
+ * 0 if the deque is empty.
+*/
+static boolean take_task(worker_t* worker, boolean from_bottom, task_t* task) {
+    if (deque_size(worker) == 0) return 0;    // saves locking the deques known to be empty
+    pthread_mutex_lock(&worker->lock);
+    boolean found = (worker->bottom != worker->top);
+    if (found && from_bottom) {
+        *task = worker->deque[(worker->bottom-1) % POOL_DEQUE_CAPACITY];
+        __atomic_store_n(&worker->bottom, worker->bottom-1, __ATOMIC_SEQ_CST);
+    } else if (found) {
+        *task = worker->deque[worker->top % POOL_DEQUE_CAPACITY];
+        __atomic_store_n(&worker->top, worker->top+1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return found;
+}
+
+
+/**
+ * Finds a task to run : from the own deque of the calling worker first, then from the deques of the other workers,
+ * starting from a random one.
+ *
+ * @param self the index of the calling worker ; -1 if the calling thread is not a worker
+ * @param task filled with the task found
+ *
+ * @returns whether a task was found
+*/
+static boolean find_task(int16_t self, task_t* task) {
+    if (self >= 0 && take_task(&workers[self], 1, task)) return 1;
+    uint8_t nb_started = __atomic_load_n(&nb_workers, __ATOMIC_ACQUIRE);    // the pool may still be starting
+    if (nb_started == 0) return 0;
+
+    uint8_t first;
+    if (self >= 0) {
+        uint64_t x = workers[self].rng;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        workers[self].rng = x;
+        first = x % nb_started;
+    } else first = __atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED) % nb_started;
+
+    for (uint8_t i = 0; i < nb_started; i++) {
+        uint8_t victim = (first + i) % nb_started;
+        if (victim == self) continue;
+        if (take_task(&workers[victim], 0, task)) {
+            if (self >= 0) add_counter(&workers[self].counters.steals, 1);
+            return 1;
+        }
+        if (self >= 0) add_counter(&workers[self].counters.failed_steals, 1);
+    }
+    return 0;
+}
+
+
+static void run_task(task_t* task) {
+    task->function(task->arg);
+    __atomic_fetch_sub(&task->group->pending, 1, __ATOMIC_RELEASE);
+}
+
+
+static boolean has_tasks() {
+    uint8_t nb_started = __atomic_load_n(&nb_workers, __ATOMIC_ACQUIRE);
+    for (uint8_t i = 0; i < nb_started; i++)
+        if (deque_size(&workers[i]) > 0) return 1;
+    return 0;
+}
+
+
+static void pin_to_cpu(uint8_t self) {
+    long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nb_cpus <= 0) return;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET((self+1) % nb_cpus, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);    // the worker stays unpinned in case of failure
+}
+
+
+/**
+ * The main loop of a worker : runs the tasks it finds, and sleeps when it finds none for a while.
+*/
+static void* worker_loop(void* arg) {
+    uint8_t self = (uint8_t) (uintptr_t) arg;
+    worker_t* worker = &workers[self];
+    current_worker = self;
+    if (pinned) pin_to_cpu(self);
+
+    uint32_t nb_failed_rounds = 0;
+    uint64_t idle_start = clock_ns();
+    while (1) {
+        task_t task;
+        if (find_task(self, &task)) {
+            add_counter(&worker->counters.idle_ns, clock_ns() - idle_start);
+            run_task(&task);
+            add_counter(&worker->counters.tasks, 1);
+            nb_failed_rounds = 0;
+            idle_start = clock_ns();
+            continue;
+        }
+        if (__atomic_load_n(&stopping, __ATOMIC_SEQ_CST)) break;
+        if (++nb_failed_rounds < FAILED_ROUNDS_BEFORE_SLEEP) {
+            sched_yield();
+            continue;
+        }
+
+        // Sleeps until a task is submitted. The deques are checked again after announcing the sleep, so that a task
+        // submitted meanwhile either is seen here or sees this worker sleeping and wakes it up.
+        pthread_mutex_lock(&sleep_lock);
+        __atomic_fetch_add(&nb_sleeping, 1, __ATOMIC_SEQ_CST);
+        if (!has_tasks() && !__atomic_load_n(&stopping, __ATOMIC_SEQ_CST)) pthread_cond_wait(&wake_up, &sleep_lock);
+        __atomic_fetch_sub(&nb_sleeping, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&sleep_lock);
+        nb_failed_rounds = 0;
+    }
+    add_counter(&worker->counters.idle_ns, clock_ns() - idle_start);
+    return NULL;
+}
+
+
+/*
+===========================================
+=================== API ===================
+===========================================
+*/
+
+
+int8_t pool_start(uint8_t nb_requested, boolean pin) {
+    if (nb_requested < 1 || nb_requested > POOL_MAX_WORKERS) return ARG_ERROR;
+    if (nb_workers == nb_requested && pinned == pin) return nb_workers;
+    pool_stop();
+
+    pinned = pin;
+    stopping = 0;
+    for (uint8_t i = 0; i < nb_requested; i++) {
+        worker_t* worker = &workers[i];
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->top = 0;
+        worker->bottom = 0;
+        worker_counters_t no_counters = {0, 0, 0, 0};
+        worker->counters = no_counters;
+        worker->rng = 0x9E3779B97F4A7C15ULL * (i+1);
+    }
+    // nb_workers is only increased once a worker is started, so that no task is dealt to a worker which doesn't exist
+    while (nb_workers < nb_requested) {
+        if (pthread_create(&workers[nb_workers].thread, NULL, worker_loop, (void*) (uintptr_t) nb_workers) != 0) break;
+        __atomic_store_n(&nb_workers, nb_workers+1, __ATOMIC_RELEASE);
+    }
+    return (nb_workers > 0) ? nb_workers : POOL_ERROR;
+}
+
+
+uint8_t pool_size() {
+    return nb_workers;
+}
+
+
+void pool_submit(task_group_t* group, task_function_t function, void* arg) {
+    task_t task = {function, arg, group};
+    __atomic_fetch_add(&group->pending, 1, __ATOMIC_RELAXED);
+    if (nb_workers == 0) {
+        run_task(&task);
+        return;
+    }
+
+    uint8_t target = (current_worker >= 0) ? current_worker
+            : __atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED) % nb_workers;
+    if (push_bottom(&workers[target], &task) != 0) {
+        run_task(&task);
+        return;
+    }
+    if (__atomic_load_n(&nb_sleeping, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&sleep_lock);
+        pthread_cond_signal(&wake_up);
+        pthread_mutex_unlock(&sleep_lock);
+    }
+}
+
+
+void pool_wait(task_group_t* group) {
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        task_t task;
+        if (nb_workers > 0 && find_task(current_worker, &task)) {
+            run_task(&task);
+            if (current_worker >= 0) add_counter(&workers[current_worker].counters.tasks, 1);
+        }
+        else sched_yield();
+    }
+}
+
+
+uint8_t pool_counters(worker_counters_t* counters, boolean reset) {
+    for (uint8_t i = 0; i < nb_workers; i++) {
+        worker_counters_t* source = &workers[i].counters;
+        uint64_t* fields[4] = {&source->tasks, &source->steals, &source->failed_steals, &source->idle_ns};
+        uint64_t* copies[4] = {&counters[i].tasks, &counters[i].steals, &counters[i].failed_steals, &counters[i].idle_ns};
+        for (uint8_t f = 0; f < 4; f++)
+            *copies[f] = reset ? __atomic_exchange_n(fields[f], 0, __ATOMIC_RELAXED) : __atomic_load_n(fields[f], __ATOMIC_RELAXED);
+    }
+    return nb_workers;
+}
+
+
+void pool_stop() {
+    if (nb_workers == 0) return;
+    __atomic_store_n(&stopping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_broadcast(&wake_up);
+    pthread_mutex_unlock(&sleep_lock);
+    for (uint8_t i = 0; i < nb_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    __atomic_store_n(&nb_workers, 0, __ATOMIC_RELEASE);
+}